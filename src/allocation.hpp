@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "order_pool.hpp"
+
+namespace me {
+    // How a taker that does not clear a level is split across the orders resting
+    // there; a compile-time parameter of BasicOrderBook.
+
+    // Strict price-time priority: the matcher walks the queue head first.
+    struct FifoAllocation {
+    };
+
+    // Shares proportional to visible size, computed for the whole level at once;
+    // the rounding remainder then goes one order at a time in queue order. With
+    // TopOrder the head of the queue is filled first and the rest shared out.
+    // The book fills slots/qty in queue order and reads fill back.
+    template<bool TopOrder>
+    class ProRataAllocation {
+    public:
+        std::vector<Slot> slots;
+        std::vector<Qty> qty;
+        std::vector<Qty> fill;
+
+        void clear() {
+            slots.clear();
+            qty.clear();
+        }
+
+        // take <= total, total == sum(qty).
+        void allocate(Qty take, Qty total) {
+            size_t n = qty.size();
+            fill.assign(n, 0);
+            size_t first = 0;
+            if constexpr (TopOrder) {
+                if (n == 0) return;
+                fill[0] = std::min(take, qty[0]);
+                take -= fill[0];
+                total -= qty[0];
+                first = 1;
+            }
+            if (take <= 0 || total <= 0) return;
+
+            const Qty *q = qty.data();
+            Qty *f = fill.data();
+            Qty given = 0;
+            if (total < (Qty{1} << 31)) {
+                // Q32 fixed point: a multiply and a shift per order, no division and
+                // no branches, so the loop vectorises.
+                uint64_t ratio = (static_cast<uint64_t>(take) << 32) / static_cast<uint64_t>(total);
+                for (size_t i = first; i < n; ++i) {
+                    f[i] = static_cast<Qty>((static_cast<uint64_t>(q[i]) * ratio) >> 32);
+                    given += f[i];
+                }
+            } else {
+                for (size_t i = first; i < n; ++i) {
+                    __extension__ typedef __int128 Wide;
+                    f[i] = static_cast<Qty>(static_cast<Wide>(q[i]) * take / total);
+                    given += f[i];
+                }
+            }
+            for (size_t i = first; given < take && i < n; ++i) {
+                Qty extra = std::min(take - given, q[i] - f[i]);
+                f[i] += extra;
+                given += extra;
+            }
+        }
+    };
+
+    using ProRata = ProRataAllocation<false>;
+    using ProRataTopOrder = ProRataAllocation<true>;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <vector>
+#include "types.hpp"
+
+namespace me {
+    struct AuctionQuote {
+        Price px{};
+        Qty volume{0};
+        // Buy minus sell qty executable at px: what is left over after the uncross.
+        Qty surplus{0};
+    };
+
+    // Equilibrium search for a call auction over the crossed part of the book.
+    // The caller pushes every price where either side rests, ascending, with the
+    // qty resting there. solve() turns the columns into cumulative sell depth (at
+    // or below) and buy depth (at or above) with two prefix scans, then picks the
+    // price in one pass: most volume, then smallest surplus, then nearest the
+    // reference price, then lowest.
+    class AuctionSolver {
+    public:
+        void clear() {
+            px_.clear();
+            bid_.clear();
+            ask_.clear();
+        }
+
+        void push(Price px, Qty bid, Qty ask) {
+            px_.push_back(px);
+            bid_.push_back(bid);
+            ask_.push_back(ask);
+        }
+
+        std::optional<AuctionQuote> solve(std::optional<Price> ref) {
+            size_t n = px_.size();
+            if (n == 0) return std::nullopt;
+            Qty *bid = bid_.data();
+            Qty *ask = ask_.data();
+            for (size_t i = 1; i < n; ++i) ask[i] += ask[i - 1];
+            for (size_t i = n - 1; i-- > 0;) bid[i] += bid[i + 1];
+
+            std::optional<AuctionQuote> best;
+            Qty best_gap = 0;
+            Price best_dist = 0;
+            for (size_t i = 0; i < n; ++i) {
+                Qty vol = bid[i] < ask[i] ? bid[i] : ask[i];
+                if (vol == 0) continue;
+                Qty surplus = bid[i] - ask[i];
+                Qty gap = surplus < 0 ? -surplus : surplus;
+                Price dist = ref ? (px_[i] > *ref ? px_[i] - *ref : *ref - px_[i]) : 0;
+                if (!best || vol > best->volume ||
+                    (vol == best->volume && (gap < best_gap || (gap == best_gap && dist < best_dist)))) {
+                    best = AuctionQuote{px_[i], vol, surplus};
+                    best_gap = gap;
+                    best_dist = dist;
+                }
+            }
+            return best;
+        }
+
+    private:
+        std::vector<Price> px_;
+        std::vector<Qty> bid_;
+        std::vector<Qty> ask_;
+    };
+}
@@ -5,11 +5,13 @@
 #include <iostream>
 #include <random>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "engine.hpp"
 #include "order_book.hpp"
 
 using namespace me;
@@ -86,19 +88,34 @@ struct Csv {
     }
 };
 
+template<class Book>
 struct Bench {
-    OrderBook ob;
+    Book ob;
     IdGen gen;
     LiveSet live;
     std::mt19937_64 rng;
 
     std::unordered_map<std::string, Stat> S;
+    std::vector<Trade> fills;
+    // When non-zero, orders are spread over this many owners and takers carry
+    // CancelOldest self-trade prevention.
+    OwnerId owners{0};
 
     explicit Bench(std::uint64_t seed) : rng(seed) {
+        fills.reserve(1024);
+    }
+
+    void stamp(Order &o) {
+        if (owners == 0) return;
+        // Derived from the id rather than drawn from rng, so the order flow is the
+        // same as without owners.
+        o.owner = static_cast<OwnerId>((o.id * 0x9E3779B97F4A7C15ull >> 32) % owners);
+        o.stp = Stp::CancelOldest;
     }
 
     void do_post(const std::string &scen, Side side, Price px, Qty qty, Csv &csv) {
         Order o{gen.next_id(), side, OrdType::Limit, px, qty, gen.next_ts()};
+        stamp(o);
         auto t0 = Clock::now();
         ob.post_passive(o); // постим без матчинга
         auto t1 = Clock::now();
@@ -108,12 +125,25 @@ struct Bench {
         live.add(o.id);
     }
 
+    void do_post_only(const std::string &scen, Side side, Price px, Qty qty, PostOnly mode, Csv &csv) {
+        Order o{gen.next_id(), side, OrdType::Limit, px, qty, gen.next_ts()};
+        o.post_only = mode;
+        auto t0 = Clock::now();
+        bool ok = ob.add_limit(o, [this](const Trade &t) { fills.push_back(t); });
+        auto t1 = Clock::now();
+        auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        S["post_only"].add((ns64) dur);
+        csv.row(scen, "post_only", (ns64) dur);
+        if (ok) live.add(o.id);
+    }
+
     void do_add_limit_cross(const std::string &scen, Side side, Price px, Qty qty, Csv &csv) {
         Order o{gen.next_id(), side, OrdType::Limit, px, qty, gen.next_ts()};
+        stamp(o);
+        fills.clear();
         auto t0 = Clock::now();
-        auto trades = ob.add_limit(o);
+        ob.add_limit(o, [this](const Trade &t) { fills.push_back(t); });
         auto t1 = Clock::now();
-        (void) trades;
         auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
         S["add_limit"].add((ns64) dur);
         csv.row(scen, "add_limit", (ns64) dur);
@@ -121,10 +151,11 @@ struct Bench {
 
     void do_add_market(const std::string &scen, Side side, Qty qty, Csv &csv) {
         Order o{gen.next_id(), side, OrdType::Market, 0, qty, gen.next_ts()};
+        stamp(o);
+        fills.clear();
         auto t0 = Clock::now();
-        auto trades = ob.add_market(o);
+        ob.add_market(o, [this](const Trade &t) { fills.push_back(t); });
         auto t1 = Clock::now();
-        (void) trades;
         auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
         S["add_market"].add((ns64) dur);
         csv.row(scen, "add_market", (ns64) dur);
@@ -145,17 +176,16 @@ struct Bench {
     void do_modify_down(const std::string &scen, Csv &csv) {
         OrderId id = live.pick(rng);
         if (id == 0) return;
+        fills.clear();
         auto t0 = Clock::now();
-        auto trades = ob.modify(id, std::nullopt, (Qty) 1, gen.next_ts());
+        ob.modify(id, std::nullopt, (Qty) 1, gen.next_ts(), [this](const Trade &t) { fills.push_back(t); });
         auto t1 = Clock::now();
-        (void) trades;
         auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
         S["modify"].add((ns64) dur);
         csv.row(scen, "modify", (ns64) dur);
     }
 
-    void run_burst(std::size_t ops, Csv &csv) {
-        const std::string scen = "burst";
+    void run_burst(std::size_t ops, Csv &csv, const std::string &scen = "burst") {
         Price mid = 10000;
         std::uniform_int_distribution<int> qtyd(1, 50);
         std::uniform_int_distribution<int> sided(0, 1);
@@ -206,7 +236,69 @@ struct Bench {
         }
         auto t_all1 = Clock::now();
         double secs = std::chrono::duration<double>(t_all1 - t_all0).count();
-        std::cout << "\n[burst] total_ops=" << ops << "  elapsed=" << secs
+        std::cout << "\n[" << scen << "] total_ops=" << ops << "  elapsed=" << secs
+                << "s  throughput=" << (ops / secs) << " ops/s\n";
+    }
+
+    // Deep queues that are then taken out in one go: isolates the matching loop.
+    void run_sweep(std::size_t ops, Csv &csv) {
+        const std::string scen = "sweep";
+        Price mid = 10000;
+        std::uniform_int_distribution<int> qtyd(1, 10);
+        const int levels = 4;
+        const int per_level = 32;
+
+        auto t_all0 = Clock::now();
+        std::size_t done = 0;
+        for (bool buy = true; done < ops; buy = !buy) {
+            Side maker_side = buy ? Side::Sell : Side::Buy;
+            Qty resting = 0;
+            for (int k = 0; k < levels * per_level; ++k) {
+                Price px = buy ? mid + k % levels : mid - k % levels;
+                Qty q = qtyd(rng);
+                do_post(scen, maker_side, px, q, csv);
+                resting += q;
+            }
+            do_add_market(scen, buy ? Side::Buy : Side::Sell, resting, csv);
+            done += levels * per_level + 1;
+        }
+        auto t_all1 = Clock::now();
+        double secs = std::chrono::duration<double>(t_all1 - t_all0).count();
+        std::cout << "\n[sweep] total_ops=" << done << "  elapsed=" << secs
+                << "s  throughput=" << (done / secs) << " ops/s\n";
+    }
+
+    // Market-maker flow: mostly post-only quotes around the touch (some would cross
+    // and get slid or rejected), with takers and cancels keeping the book moving.
+    void run_maker(std::size_t ops, Csv &csv) {
+        const std::string scen = "maker";
+        Price mid = 10000;
+        std::uniform_int_distribution<int> qtyd(1, 50);
+        std::uniform_int_distribution<int> sided(0, 1);
+        std::uniform_int_distribution<int> offd(-2, 6);
+
+        for (int i = 0; i < 200; ++i) {
+            Side s = (i & 1) ? Side::Buy : Side::Sell;
+            Price px = (s == Side::Buy) ? mid - 1 - (i % 8) : mid + 1 + (i % 8);
+            do_post(scen, s, px, qtyd(rng), csv);
+        }
+
+        auto t_all0 = Clock::now();
+        for (std::size_t i = 0; i < ops; ++i) {
+            int r = (int) (i % 10);
+            Side s = sided(rng) ? Side::Buy : Side::Sell;
+            if (r < 8) {
+                Price px = (s == Side::Buy) ? mid - offd(rng) : mid + offd(rng);
+                do_post_only(scen, s, px, qtyd(rng), (i & 1) ? PostOnly::Slide : PostOnly::Reject, csv);
+            } else if (r == 8) {
+                do_add_market(scen, s, qtyd(rng), csv);
+            } else {
+                do_cancel(scen, csv);
+            }
+        }
+        auto t_all1 = Clock::now();
+        double secs = std::chrono::duration<double>(t_all1 - t_all0).count();
+        std::cout << "\n[maker] total_ops=" << ops << "  elapsed=" << secs
                 << "s  throughput=" << (ops / secs) << " ops/s\n";
     }
 
@@ -270,25 +362,157 @@ struct Bench {
     }
 };
 
-int main(int argc, char **argv) {
-    std::string scenario = (argc >= 2) ? argv[1] : "burst";
-    std::size_t ops = (argc >= 3) ? static_cast<std::size_t>(std::stoull(argv[2])) : 100000;
-    std::uint64_t seed = (argc >= 4) ? std::stoull(argv[3]) : 42;
-
-    Bench B(seed);
+template<class Book>
+static int run(const std::string &scenario, std::size_t ops, std::uint64_t seed) {
+    Bench<Book> B(seed);
     Csv csv("bench_results.csv");
 
     if (scenario == "burst") {
         B.run_burst(ops, csv);
+    } else if (scenario == "burst-stp") {
+        // burst with owners and self-trade prevention on every taker
+        B.owners = 16;
+        B.run_burst(ops, csv, scenario);
     } else if (scenario == "poisson") {
         B.run_poisson(ops, csv);
+    } else if (scenario == "sweep") {
+        B.run_sweep(ops, csv);
+    } else if (scenario == "maker") {
+        B.run_maker(ops, csv);
     } else {
-        std::cerr << "Unknown scenario: " << scenario << " (use: burst | poisson)\n";
+        std::cerr << "Unknown scenario: " << scenario << " (use: burst | burst-stp | poisson | sweep | maker | scale)\n";
         return 2;
     }
 
     std::cout << "\n=== per-op latency percentiles ===\n";
     for (auto &[name, stat]: B.S) stat.summary(name);
+    LadderStats ls = B.ob.level_stats();
+    std::cout << "levels created=" << ls.levels_created << "  reused=" << ls.levels_reused << "\n";
     std::cout << "CSV -> bench_results.csv\n";
     return 0;
 }
+
+static ns64 now_ns() {
+    return static_cast<ns64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count());
+}
+
+// Splits a command's time into the wait in the ring (gateway stamp to dequeue)
+// and the matching itself.
+struct LatencyListener {
+    Stat queue;
+    Stat match;
+    ns64 t0{0};
+
+    void on_trade(SymbolId, const Trade &) {
+    }
+
+    void on_dequeue(const Command &c) {
+        t0 = now_ns();
+        queue.add(t0 - c.sent);
+    }
+
+    void on_applied(const Command &, bool) { match.add(now_ns() - t0); }
+};
+
+// Same command stream over `symbols` books, replayed through engines of 1..max
+// workers. Commands are generated up front so the gateway thread only routes
+// and stamps them; latency is reported from the last run.
+template<class Book>
+static int run_scale(std::size_t ops, std::uint64_t seed, std::size_t max_workers) {
+    const std::size_t symbols = 256;
+    const Price mid = 2048;
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<SymbolId> symd(0, static_cast<SymbolId>(symbols - 1));
+    std::uniform_int_distribution<int> opd(0, 9);
+    std::uniform_int_distribution<Price> offd(1, 20);
+    std::uniform_int_distribution<Qty> qtyd(1, 100);
+    std::vector<std::vector<OrderId> > live(symbols);
+
+    std::vector<Command> cmds;
+    cmds.reserve(ops);
+    for (OrderId id = 1; cmds.size() < ops; ++id) {
+        Command c;
+        c.symbol = symd(rng);
+        Side s = (rng() & 1) ? Side::Buy : Side::Sell;
+        int op = opd(rng);
+        auto &ids = live[c.symbol];
+        if (op == 9 && !ids.empty()) {
+            std::uniform_int_distribution<size_t> di(0, ids.size() - 1);
+            size_t i = di(rng);
+            c.kind = Command::Kind::Cancel;
+            c.order.id = ids[i];
+            ids[i] = ids.back();
+            ids.pop_back();
+        } else if (op == 8) {
+            c.kind = Command::Kind::Market;
+            c.order = {id, s, OrdType::Market, 0, qtyd(rng), id};
+        } else {
+            // 6 in 8 rest behind the mid, the rest cross it
+            Price off = op < 6 ? offd(rng) : -offd(rng);
+            c.order = {id, s, OrdType::Limit, s == Side::Buy ? mid - off : mid + off, qtyd(rng), id};
+            ids.push_back(id);
+        }
+        cmds.push_back(c);
+    }
+
+    EngineConfig cfg;
+    cfg.symbols = symbols;
+    cfg.book.px_max = 4095;
+    cfg.book.order_capacity = 1024;
+    double base = 0;
+    std::cout << "[scale] symbols=" << symbols << "  ops=" << ops
+            << "  cpus=" << std::thread::hardware_concurrency() << "\n";
+    for (std::size_t w = 1; w <= max_workers; ++w) {
+        cfg.workers = w;
+        MatchingEngine<Book, LatencyListener> eng(cfg);
+        eng.start();
+        auto t0 = Clock::now();
+        for (Command &c: cmds) {
+            c.sent = now_ns();
+            eng.submit(c);
+        }
+        eng.flush();
+        auto t1 = Clock::now();
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        double tput = ops / secs;
+        if (w == 1) base = tput;
+        uint64_t trades = 0;
+        for (std::size_t i = 0; i < w; ++i) trades += eng.stats(i).trades;
+        std::cout << "workers=" << w << "  elapsed=" << secs << "s  throughput=" << tput
+                << " ops/s  speedup=" << (tput / base) << "x  trades=" << trades << "\n";
+        if (w == max_workers) {
+            Stat queue, match;
+            for (std::size_t i = 0; i < w; ++i) {
+                auto &l = eng.listener(i);
+                queue.lat.insert(queue.lat.end(), l.queue.lat.begin(), l.queue.lat.end());
+                match.lat.insert(match.lat.end(), l.match.lat.begin(), l.match.lat.end());
+            }
+            queue.summary("enqueue->match");
+            match.summary("match");
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::string scenario = (argc >= 2) ? argv[1] : "burst";
+    std::size_t ops = (argc >= 3) ? static_cast<std::size_t>(std::stoull(argv[2])) : 100000;
+    std::uint64_t seed = (argc >= 4) ? std::stoull(argv[3]) : 42;
+    std::string book = (argc >= 5) ? argv[4] : "map";
+
+    if (scenario == "scale") {
+        std::size_t hw = std::max(1u, std::thread::hardware_concurrency());
+        std::size_t workers = (argc >= 6) ? static_cast<std::size_t>(std::stoull(argv[5])) : hw;
+        if (book == "map") return run_scale<OrderBook>(ops, seed, workers);
+        if (book == "dense") return run_scale<DenseOrderBook>(ops, seed, workers);
+    }
+
+    if (book == "map") return run<OrderBook>(scenario, ops, seed);
+    if (book == "dense") return run<DenseOrderBook>(scenario, ops, seed);
+    if (book == "dense-seqid") return run<BasicOrderBook<ArrayLadder, DenseIdIndex> >(scenario, ops, seed);
+    if (book == "compact") return run<CompactOrderBook>(scenario, ops, seed);
+    if (book == "prorata") return run<ProRataOrderBook>(scenario, ops, seed);
+    std::cerr << "Unknown book: " << book << " (use: map | dense | dense-seqid | compact | prorata)\n";
+    return 2;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <vector>
+#include "types.hpp"
+
+namespace me {
+    // Fenwick tree over per-level quantities, laid out in priority order (position 0
+    // is the most aggressive price). Both "qty available through position p" and
+    // "first position where the running qty reaches q" are O(log n).
+    class DepthTree {
+    public:
+        explicit DepthTree(size_t n) : tree_(n + 1, 0) {
+        }
+
+        size_t size() const { return tree_.size() - 1; }
+
+        void add(size_t pos, Qty delta) {
+            for (size_t i = pos + 1; i < tree_.size(); i += i & (~i + 1)) tree_[i] += delta;
+        }
+
+        // Sum of positions [0, pos].
+        Qty prefix(size_t pos) const {
+            Qty s = 0;
+            for (size_t i = pos + 1; i > 0; i &= i - 1) s += tree_[i];
+            return s;
+        }
+
+        // Smallest pos with prefix(pos) >= q, or size() if the total is short of q.
+        size_t lower_bound(Qty q) const {
+            size_t pos = 0;
+            for (size_t step = std::bit_floor(size()); step; step >>= 1) {
+                if (pos + step < tree_.size() && tree_[pos + step] < q) {
+                    pos += step;
+                    q -= tree_[pos];
+                }
+            }
+            return pos;
+        }
+
+    private:
+        std::vector<Qty> tree_;
+    };
+}
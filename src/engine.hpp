@@ -0,0 +1,242 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "order_book.hpp"
+#include "spsc_ring.hpp"
+
+namespace me {
+    using SymbolId = uint32_t;
+
+    // One request for one instrument. Limit also carries stops and pegs (by
+    // Order::type / Order::peg); Cancel and Modify address order.id, and Modify
+    // takes its timestamp from order.ts. Fixed size and trivially copyable, so it
+    // travels through the ingress ring by plain copy.
+    struct Command {
+        enum class Kind : uint8_t { Limit, Market, Cancel, Modify };
+
+        Kind kind{Kind::Limit};
+        SymbolId symbol{0};
+        Order order{};
+        std::optional<Price> new_px{};
+        std::optional<Qty> new_qty{};
+        // Gateway's enqueue stamp; passed through untouched for latency accounting.
+        Ts sent{0};
+    };
+
+    struct EngineConfig {
+        std::size_t workers{1};
+        std::size_t symbols{1};
+        // Worker w runs on CPU first_cpu + w (mod the CPU count); Linux only.
+        bool pin{true};
+        std::size_t first_cpu{0};
+        // Commands in flight per worker, and how many submit() stages before it
+        // publishes them (flush() and publish() always publish).
+        std::size_t ring_capacity{1 << 16};
+        std::size_t publish_batch{1};
+        // Every book is built from this, on the thread that owns it.
+        BookConfig book{};
+    };
+
+    // Receives the output of one worker; each worker has its own instance. A
+    // listener may also define on_dequeue(const Command&) and
+    // on_applied(const Command&, bool ok), called around each command.
+    struct NullListener {
+        void on_trade(SymbolId, const Trade &) {
+        }
+    };
+
+    // Many books, sharded by symbol across worker threads. Symbol s belongs to
+    // worker s % workers and only that thread ever touches its book, so matching
+    // takes no locks and shares no state. Each worker is fed by its own SPSC ring
+    // and busy-polls it; submit(), publish() and flush() are meant for a single
+    // gateway thread.
+    template<class Book = OrderBook, class Listener = NullListener>
+    class MatchingEngine {
+    public:
+        struct WorkerStats {
+            uint64_t commands{0};
+            uint64_t trades{0};
+            uint64_t rejects{0};
+        };
+
+        explicit MatchingEngine(const EngineConfig &cfg) : cfg_(cfg) {
+            if (cfg_.workers == 0) cfg_.workers = 1;
+            workers_.reserve(cfg_.workers);
+            if (cfg_.publish_batch == 0) cfg_.publish_batch = 1;
+            for (std::size_t w = 0; w < cfg_.workers; ++w) workers_.push_back(std::make_unique<Worker>(cfg_.ring_capacity));
+        }
+
+        ~MatchingEngine() { stop(); }
+
+        MatchingEngine(const MatchingEngine &) = delete;
+        MatchingEngine &operator=(const MatchingEngine &) = delete;
+
+        // Returns once every worker has built its books.
+        void start() {
+            if (running_) return;
+            running_ = true;
+            for (std::size_t w = 0; w < workers_.size(); ++w) {
+                workers_[w]->stopping.store(false, std::memory_order_relaxed);
+                workers_[w]->thread = std::thread([this, w] { run(w); });
+            }
+            while (ready_.load(std::memory_order_acquire) < workers_.size()) std::this_thread::yield();
+        }
+
+        // Drains what was submitted, then joins the workers. Books are kept.
+        void stop() {
+            if (!running_) return;
+            for (auto &wp: workers_) {
+                wp->ring.publish();
+                wp->stopping.store(true, std::memory_order_release);
+            }
+            for (auto &wp: workers_) wp->thread.join();
+            ready_.store(0, std::memory_order_relaxed);
+            running_ = false;
+        }
+
+        // Returns false for an unknown symbol or while stopped. Waits for room if
+        // the worker's ring is full.
+        bool submit(const Command &c) {
+            if (!running_ || c.symbol >= cfg_.symbols) return false;
+            Worker &w = *workers_[worker_of(c.symbol)];
+            if (!w.ring.try_push(c)) {
+                w.ring.publish();
+                while (!w.ring.try_push(c)) std::this_thread::yield();
+            }
+            ++w.submitted;
+            if (w.ring.unpublished() >= cfg_.publish_batch) w.ring.publish();
+            return true;
+        }
+
+        void publish() {
+            for (auto &wp: workers_) wp->ring.publish();
+        }
+
+        // Publishes, then waits until every submitted command has been applied;
+        // afterwards books, stats and listeners may be read from the calling thread.
+        void flush() {
+            publish();
+            for (const auto &wp: workers_) {
+                while (wp->done.load(std::memory_order_acquire) != wp->submitted) std::this_thread::yield();
+            }
+        }
+
+        std::size_t workers() const { return workers_.size(); }
+        std::size_t symbols() const { return cfg_.symbols; }
+        std::size_t worker_of(SymbolId s) const { return s % workers_.size(); }
+
+        // Only while quiescent: after flush() or stop().
+        const Book &book(SymbolId s) const { return *workers_[worker_of(s)]->books[s / workers_.size()]; }
+        const WorkerStats &stats(std::size_t w) const { return workers_[w]->stats; }
+        Listener &listener(std::size_t w) { return workers_[w]->listener; }
+
+    private:
+        struct alignas(64) Worker {
+            explicit Worker(std::size_t capacity) : ring(capacity) {
+            }
+
+            SpscRing<Command> ring;
+            // Polled by the worker.
+            alignas(64) std::atomic<bool> stopping{false};
+            // Gateway side, written on every submit; compared against done by flush().
+            alignas(64) uint64_t submitted{0};
+
+            alignas(64) std::atomic<uint64_t> done{0};
+            std::vector<std::unique_ptr<Book> > books;
+            WorkerStats stats;
+            Listener listener;
+            std::thread thread;
+        };
+
+        EngineConfig cfg_;
+        std::vector<std::unique_ptr<Worker> > workers_;
+        std::atomic<std::size_t> ready_{0};
+        bool running_{false};
+
+        // Bounds how long done lags behind the commands applied.
+        static constexpr std::size_t kDrainBatch = 256;
+        static constexpr unsigned kSpinsBeforeYield = 64;
+
+        void pin(std::size_t w) const {
+#ifdef __linux__
+            if (!cfg_.pin) return;
+            unsigned n = std::thread::hardware_concurrency();
+            if (n == 0) return;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET((cfg_.first_cpu + w) % n, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+            (void) w;
+#endif
+        }
+
+        void run(std::size_t w) {
+            Worker &self = *workers_[w];
+            pin(w);
+            // Built after pinning so the books are first touched by the core that uses them.
+            if (self.books.empty()) {
+                std::size_t n = (cfg_.symbols + workers_.size() - 1 - w) / workers_.size();
+                self.books.reserve(n);
+                for (std::size_t i = 0; i < n; ++i) self.books.push_back(std::make_unique<Book>(cfg_.book));
+            }
+            ready_.fetch_add(1, std::memory_order_release);
+
+            // Spins while idle, yielding after a while so oversubscribed cores still progress.
+            unsigned idle = 0;
+            for (;;) {
+                std::size_t n = self.ring.drain([this, &self](const Command &c) { apply(self, c); }, kDrainBatch);
+                if (n) {
+                    self.done.fetch_add(n, std::memory_order_release);
+                    idle = 0;
+                    continue;
+                }
+                // stop() publishes before raising the flag, so one more empty drain means done.
+                if (self.stopping.load(std::memory_order_acquire)) {
+                    n = self.ring.drain([this, &self](const Command &c) { apply(self, c); });
+                    self.done.fetch_add(n, std::memory_order_release);
+                    if (!n) return;
+                    continue;
+                }
+                if (++idle >= kSpinsBeforeYield) std::this_thread::yield();
+            }
+        }
+
+        void apply(Worker &self, const Command &c) {
+            Book &ob = *self.books[c.symbol / workers_.size()];
+            auto sink = [&self, sym = c.symbol](const Trade &t) {
+                ++self.stats.trades;
+                self.listener.on_trade(sym, t);
+            };
+            if constexpr (requires { self.listener.on_dequeue(c); }) self.listener.on_dequeue(c);
+            bool ok = false;
+            switch (c.kind) {
+                case Command::Kind::Limit:
+                    if (c.order.type == OrdType::Stop || c.order.type == OrdType::StopLimit) ok = ob.add_stop(c.order, sink);
+                    else if (c.order.peg != PegType::None) ok = ob.add_peg(c.order);
+                    else ok = ob.add_limit(c.order, sink);
+                    break;
+                case Command::Kind::Market:
+                    ok = ob.add_market(c.order, sink);
+                    break;
+                case Command::Kind::Cancel:
+                    ok = ob.cancel(c.order.id);
+                    break;
+                case Command::Kind::Modify:
+                    ok = ob.modify(c.order.id, c.new_px, c.new_qty, c.order.ts, sink);
+                    break;
+            }
+            ++self.stats.commands;
+            if (!ok) ++self.stats.rejects;
+            if constexpr (requires { self.listener.on_applied(c, ok); }) self.listener.on_applied(c, ok);
+        }
+    };
+}
@@ -0,0 +1,252 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "types.hpp"
+
+namespace me {
+    // Open-addressing OrderId -> V table with linear probing. Deletes shift the rest
+    // of the probe run back instead of leaving tombstones, so lookups never degrade
+    // under cancel-heavy flow. kNoOrderId is the empty marker: it is never found,
+    // inserted or erased.
+    template<class V>
+    class FlatIdMap {
+    public:
+        static constexpr OrderId kEmpty = kNoOrderId;
+
+        explicit FlatIdMap(size_t capacity = 0) { rehash(slots_for(capacity)); }
+
+        explicit FlatIdMap(const BookConfig &cfg) : FlatIdMap(cfg.order_capacity) {
+        }
+
+        V *find(OrderId id) {
+            if (id == kEmpty) return nullptr;
+            for (size_t i = home(id);; i = (i + 1) & mask_) {
+                Entry &e = slots_[i];
+                if (e.key == id) return &e.val;
+                if (e.key == kEmpty) return nullptr;
+            }
+        }
+
+        const V *find(OrderId id) const { return const_cast<FlatIdMap *>(this)->find(id); }
+
+        // Returns false if the id is already present.
+        bool insert(OrderId id, const V &v) {
+            if (id == kEmpty) return false;
+            if ((size_ + 1) * 2 > slots_.size()) rehash(slots_.size() * 2);
+            size_t i = home(id);
+            for (; slots_[i].key != kEmpty; i = (i + 1) & mask_) {
+                if (slots_[i].key == id) return false;
+            }
+            slots_[i] = Entry{id, v};
+            ++size_;
+            return true;
+        }
+
+        bool erase(OrderId id) {
+            if (id == kEmpty) return false;
+            size_t i = home(id);
+            for (; slots_[i].key != id; i = (i + 1) & mask_) {
+                if (slots_[i].key == kEmpty) return false;
+            }
+            for (size_t j = (i + 1) & mask_; slots_[j].key != kEmpty; j = (j + 1) & mask_) {
+                size_t h = home(slots_[j].key);
+                // Move j back into the hole unless its home lies cyclically in (i, j].
+                bool stays = (i <= j) ? (i < h && h <= j) : (i < h || h <= j);
+                if (!stays) {
+                    slots_[i] = slots_[j];
+                    i = j;
+                }
+            }
+            slots_[i].key = kEmpty;
+            --size_;
+            return true;
+        }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        void clear() {
+            for (auto &e: slots_) e.key = kEmpty;
+            size_ = 0;
+        }
+
+    private:
+        struct Entry {
+            OrderId key{kEmpty};
+            V val{};
+        };
+
+        std::vector<Entry> slots_;
+        size_t mask_{0};
+        int shift_{64};
+        size_t size_{0};
+
+        static size_t slots_for(size_t capacity) {
+            return std::bit_ceil(capacity < 8 ? size_t{16} : capacity * 2);
+        }
+
+        size_t home(OrderId id) const {
+            return static_cast<size_t>((id * 0x9E3779B97F4A7C15ull) >> shift_);
+        }
+
+        void rehash(size_t n) {
+            std::vector<Entry> old;
+            old.swap(slots_);
+            slots_.assign(n, Entry{});
+            mask_ = n - 1;
+            shift_ = 64 - std::countr_zero(n);
+            size_ = 0;
+            for (const auto &e: old) {
+                if (e.key != kEmpty) insert(e.key, e.val);
+            }
+        }
+    };
+
+    // Direct-indexed table for gateways that hand out OrderIds sequentially from
+    // base_id: a lookup is a window check plus one load from a fixed-size page.
+    // A page is allocated when its first id arrives and recycled as soon as it
+    // holds no live id and is not the page the newest id is on, so one
+    // long-lived order pins only its own page and memory tracks the live ids
+    // rather than the session length. Ids below the oldest live page, or more
+    // than kMaxPages pages beyond it, are rejected by insert().
+    template<class V>
+    class DenseIdIndex {
+    public:
+        static constexpr unsigned kPageBits = 12;
+        static constexpr size_t kPageSize = size_t{1} << kPageBits;
+        static constexpr uint64_t kMaxPages = uint64_t{1} << 20;
+
+        explicit DenseIdIndex(const BookConfig &cfg) : base_(cfg.base_id) {
+            ring_.resize(std::bit_ceil(std::max<size_t>(cfg.order_capacity >> kPageBits, 4)));
+            mask_ = ring_.size() - 1;
+        }
+
+        V *find(OrderId id) {
+            if (id < base_) return nullptr;
+            uint64_t rel = id - base_;
+            uint64_t pn = rel >> kPageBits;
+            if (pn < lo_ || pn >= hi_) return nullptr;
+            Page *p = ring_[pn & mask_].get();
+            size_t i = rel & (kPageSize - 1);
+            return p && p->has(i) ? &p->vals[i] : nullptr;
+        }
+
+        const V *find(OrderId id) const { return const_cast<DenseIdIndex *>(this)->find(id); }
+
+        bool insert(OrderId id, const V &v) {
+            if (id < base_) return false;
+            uint64_t rel = id - base_;
+            uint64_t pn = rel >> kPageBits;
+            if (lo_ == hi_) lo_ = hi_ = newest_ = pn;
+            if (pn < lo_ || pn - lo_ >= kMaxPages) return false;
+            while (pn >= hi_) {
+                if (hi_ - lo_ == ring_.size()) grow_ring();
+                ++hi_;
+            }
+            auto &slot = ring_[pn & mask_];
+            if (!slot) slot = take_page();
+            Page &p = *slot;
+            size_t i = rel & (kPageSize - 1);
+            if (p.has(i)) return false;
+            p.set(i);
+            p.vals[i] = v;
+            ++p.live;
+            ++size_;
+            if (pn > newest_) {
+                uint64_t prev = newest_;
+                newest_ = pn;
+                release_if_idle(prev);
+            }
+            return true;
+        }
+
+        bool erase(OrderId id) {
+            if (id < base_) return false;
+            uint64_t rel = id - base_;
+            uint64_t pn = rel >> kPageBits;
+            if (pn < lo_ || pn >= hi_) return false;
+            Page *p = ring_[pn & mask_].get();
+            size_t i = rel & (kPageSize - 1);
+            if (!p || !p->has(i)) return false;
+            p->reset(i);
+            --p->live;
+            --size_;
+            if (p->live == 0) release_if_idle(pn);
+            return true;
+        }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        size_t pages_in_use() const { return pages_; }
+
+        void clear() {
+            for (uint64_t pn = lo_; pn < hi_; ++pn) {
+                if (ring_[pn & mask_]) recycle(pn);
+            }
+            lo_ = hi_;
+            size_ = 0;
+        }
+
+    private:
+        struct Page {
+            std::array<uint64_t, kPageSize / 64> used{};
+            std::array<V, kPageSize> vals{};
+            uint32_t live{0};
+
+            bool has(size_t i) const { return (used[i >> 6] >> (i & 63)) & 1u; }
+            void set(size_t i) { used[i >> 6] |= uint64_t{1} << (i & 63); }
+            void reset(size_t i) { used[i >> 6] &= ~(uint64_t{1} << (i & 63)); }
+        };
+
+        // Recycled pages kept for reuse; the rest go back to the allocator.
+        static constexpr size_t kSpareCap = 8;
+
+        OrderId base_;
+        // Pages of [lo_, hi_) by pn & mask_; null where no id is live.
+        std::vector<std::unique_ptr<Page> > ring_;
+        size_t mask_{0};
+        uint64_t lo_{0};
+        uint64_t hi_{0};
+        uint64_t newest_{0};
+        size_t size_{0};
+        size_t pages_{0};
+        std::vector<std::unique_ptr<Page> > spare_;
+
+        std::unique_ptr<Page> take_page() {
+            ++pages_;
+            if (spare_.empty()) return std::make_unique<Page>();
+            auto p = std::move(spare_.back());
+            spare_.pop_back();
+            return p;
+        }
+
+        void recycle(uint64_t pn) {
+            auto &slot = ring_[pn & mask_];
+            slot->used.fill(0);
+            slot->live = 0;
+            if (spare_.size() < kSpareCap) spare_.push_back(std::move(slot));
+            else slot.reset();
+            --pages_;
+        }
+
+        void release_if_idle(uint64_t pn) {
+            if (pn == newest_ || pn < lo_ || pn >= hi_) return;
+            Page *p = ring_[pn & mask_].get();
+            if (!p || p->live != 0) return;
+            recycle(pn);
+            while (lo_ < hi_ && !ring_[lo_ & mask_]) ++lo_;
+        }
+
+        void grow_ring() {
+            std::vector<std::unique_ptr<Page> > bigger(ring_.size() * 2);
+            for (uint64_t pn = lo_; pn < hi_; ++pn) bigger[pn & (bigger.size() - 1)] = std::move(ring_[pn & mask_]);
+            ring_.swap(bigger);
+            mask_ = ring_.size() - 1;
+        }
+    };
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace me {
+    // Occupancy bitset with summary levels: bit i of level k+1 is set iff word i of
+    // level k is non-zero. Nearest set bit in either direction costs one
+    // tzcnt/lzcnt per level (three levels cover 262144 ticks).
+    class LevelBitmap {
+    public:
+        static constexpr size_t npos = SIZE_MAX;
+
+        explicit LevelBitmap(size_t n) {
+            size_t words = (n + 63) / 64;
+            for (;;) {
+                levels_.emplace_back(words ? words : 1, 0);
+                if (words <= 1) break;
+                words = (words + 63) / 64;
+            }
+        }
+
+        bool test(size_t i) const { return (levels_[0][i >> 6] >> (i & 63)) & 1u; }
+
+        void set(size_t i) {
+            for (auto &lvl: levels_) {
+                uint64_t &w = lvl[i >> 6];
+                bool had_any = w != 0;
+                w |= uint64_t{1} << (i & 63);
+                if (had_any) return;
+                i >>= 6;
+            }
+        }
+
+        void reset(size_t i) {
+            for (auto &lvl: levels_) {
+                uint64_t &w = lvl[i >> 6];
+                w &= ~(uint64_t{1} << (i & 63));
+                if (w != 0) return;
+                i >>= 6;
+            }
+        }
+
+        // Lowest set index >= i, or npos.
+        size_t next_at_or_after(size_t i) const {
+            size_t k = 0;
+            for (;;) {
+                size_t w = i >> 6;
+                if (w >= levels_[k].size()) return npos;
+                uint64_t m = levels_[k][w] & (~uint64_t{0} << (i & 63));
+                if (m) {
+                    i = (w << 6) + std::countr_zero(m);
+                    break;
+                }
+                if (++k == levels_.size()) return npos;
+                i = w + 1;
+            }
+            while (k-- > 0) i = (i << 6) + std::countr_zero(levels_[k][i]);
+            return i;
+        }
+
+        // Highest set index <= i, or npos.
+        size_t prev_at_or_before(size_t i) const {
+            size_t k = 0;
+            for (;;) {
+                size_t w = i >> 6;
+                uint64_t m = levels_[k][w] & (~uint64_t{0} >> (63 - (i & 63)));
+                if (m) {
+                    i = (w << 6) + 63 - std::countl_zero(m);
+                    break;
+                }
+                if (w == 0 || ++k == levels_.size()) return npos;
+                i = w - 1;
+            }
+            while (k-- > 0) i = (i << 6) + 63 - std::countl_zero(levels_[k][i]);
+            return i;
+        }
+
+    private:
+        std::vector<std::vector<uint64_t> > levels_;
+    };
+}
@@ -1,5 +1,11 @@
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "engine.hpp"
 #include "order_book.hpp"
+#include "spsc_ring.hpp"
 using namespace me;
 
 static int fails = 0;
@@ -7,8 +13,9 @@ static int fails = 0;
 #define REQUIRE_EQ(a,b) do{ auto _a=(a); auto _b=(b); if(!(_a==_b)){ \
   std::cerr<<"[FAIL] line "<<__LINE__<<": " #a " == " #b " ("<<_a<<" vs "<<_b<<")\n"; ++fails; } }while(0)
 
+template<class Book>
 void check_full_fill() {
-    OrderBook ob;
+    Book ob;
     ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 100, 1});
     auto t = ob.add_limit({2, Side::Buy, OrdType::Limit, 101, 100, 2});
     REQUIRE_EQ(t.size(), 1u);
@@ -17,8 +24,9 @@ void check_full_fill() {
     REQUIRE(!ob.best_ask().has_value());
 }
 
+template<class Book>
 void check_partial_then_post() {
-    OrderBook ob;
+    Book ob;
     ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 50, 1});
     auto t = ob.add_limit({2, Side::Buy, OrdType::Limit, 101, 80, 2});
     REQUIRE_EQ(t.size(), 1u);
@@ -29,8 +37,9 @@ void check_partial_then_post() {
     REQUIRE_EQ(bb->second, 30);
 }
 
+template<class Book>
 void check_fifo() {
-    OrderBook ob;
+    Book ob;
     ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
     ob.post_passive({2, Side::Sell, OrdType::Limit, 100, 20, 2});
     auto t = ob.add_limit({3, Side::Buy, OrdType::Limit, 101, 30, 3});
@@ -39,8 +48,9 @@ void check_fifo() {
     REQUIRE_EQ(t[1].maker_id, 2);
 }
 
+template<class Book>
 void check_modify_qty_down_in_place() {
-    OrderBook ob;
+    Book ob;
     ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 50, 1});
     ob.post_passive({2, Side::Sell, OrdType::Limit, 100, 30, 2});
     auto t0 = ob.modify(2, std::nullopt, 10, 5);
@@ -52,8 +62,40 @@ void check_modify_qty_down_in_place() {
     REQUIRE(!ob.best_ask().has_value());
 }
 
+template<class Book>
+void check_modify_relink() {
+    Book ob;
+    ob.post_passive({1, Side::Buy, OrdType::Limit, 100, 5, 1});
+    ob.post_passive({2, Side::Buy, OrdType::Limit, 100, 5, 2});
+    ob.post_passive({3, Side::Buy, OrdType::Limit, 99, 5, 3});
+    ob.post_passive({4, Side::Sell, OrdType::Limit, 105, 5, 4});
+
+    // Qty up: same level, back of the queue.
+    REQUIRE(ob.modify(1, std::nullopt, 8, 10).empty());
+    REQUIRE_EQ(ob.best_bid()->second, 13);
+    auto tr = ob.add_market({5, Side::Sell, OrdType::Market, 0, 5, 11});
+    REQUIRE_EQ(tr.size(), 1u);
+    REQUIRE_EQ(tr[0].maker_id, 2u);
+
+    // Onto an existing level, then onto a new one, without crossing.
+    REQUIRE(ob.modify(3, 100, std::nullopt, 12).empty());
+    REQUIRE_EQ(ob.best_bid()->second, 13);
+    REQUIRE(ob.modify(3, 101, 4, 13).empty());
+    REQUIRE_EQ(ob.best_bid()->first, 101);
+    REQUIRE_EQ(ob.best_bid()->second, 4);
+    REQUIRE(ob.cancel(3));
+    REQUIRE_EQ(ob.best_bid()->second, 8);
+
+    // A crossing reprice still trades.
+    tr = ob.modify(1, 105, std::nullopt, 14);
+    REQUIRE_EQ(tr.size(), 1u);
+    REQUIRE_EQ(tr[0].maker_id, 4u);
+    REQUIRE_EQ(ob.best_bid()->second, 3);
+}
+
+template<class Book>
 void check_market_buy() {
-    OrderBook ob;
+    Book ob;
     ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 50, 1});
     ob.post_passive({2, Side::Sell, OrdType::Limit, 101, 70, 2});
     auto t = ob.add_market({3, Side::Buy, OrdType::Market, 0, 60, 3});
@@ -68,8 +110,9 @@ void check_market_buy() {
     REQUIRE_EQ(a->second, 60);
 }
 
+template<class Book>
 void check_cancel() {
-    OrderBook ob;
+    Book ob;
     ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 30, 1});
     ob.post_passive({2, Side::Sell, OrdType::Limit, 100, 40, 2});
     REQUIRE(ob.cancel(1));
@@ -78,13 +121,942 @@ void check_cancel() {
     REQUIRE_EQ(a->second, 40);
 }
 
+void check_dense_ladder() {
+    DenseOrderBook ob(BookConfig{90, 120, 2});
+    REQUIRE(!ob.post_passive({1, Side::Sell, OrdType::Limit, 101, 10, 1}).has_value());
+    REQUIRE(!ob.post_passive({2, Side::Sell, OrdType::Limit, 122, 10, 2}).has_value());
+    ob.post_passive({3, Side::Sell, OrdType::Limit, 110, 10, 3});
+    ob.post_passive({4, Side::Sell, OrdType::Limit, 100, 10, 4});
+    ob.post_passive({5, Side::Buy, OrdType::Limit, 92, 10, 5});
+    REQUIRE_EQ(ob.best_ask()->first, 100);
+    REQUIRE(ob.cancel(4));
+    REQUIRE_EQ(ob.best_ask()->first, 110);
+    auto t = ob.add_limit({6, Side::Sell, OrdType::Limit, 90, 15, 6});
+    REQUIRE_EQ(t.size(), 1u);
+    REQUIRE(!ob.best_bid().has_value());
+    REQUIRE_EQ(ob.best_ask()->first, 90);
+    REQUIRE_EQ(ob.best_ask()->second, 5);
+}
+
+void check_pool_slots() {
+    BookConfig cfg;
+    cfg.order_capacity = 2;
+    OrderBook ob(cfg);
+    auto h1 = ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+    auto h2 = ob.post_passive({2, Side::Sell, OrdType::Limit, 100, 20, 2});
+    auto h3 = ob.post_passive({3, Side::Sell, OrdType::Limit, 101, 30, 3});
+    REQUIRE(h1 && h2 && h3);
+    REQUIRE(ob.cancel(2));
+    auto h4 = ob.post_passive({4, Side::Sell, OrdType::Limit, 100, 40, 4});
+    REQUIRE(h4.has_value());
+    REQUIRE_EQ(h4->slot, h2->slot);
+    auto t = ob.add_market({5, Side::Buy, OrdType::Market, 0, 80, 5});
+    REQUIRE_EQ(t.size(), 3u);
+    REQUIRE_EQ(t[0].maker_id, 1u);
+    REQUIRE_EQ(t[1].maker_id, 4u);
+    REQUIRE_EQ(t[2].maker_id, 3u);
+    REQUIRE(!ob.best_ask().has_value());
+}
+
+void check_flat_id_map() {
+    FlatIdMap<int> m(4);
+    for (OrderId id = 1; id <= 1000; ++id) REQUIRE(m.insert(id * 7, static_cast<int>(id)));
+    REQUIRE(!m.insert(7, 0));
+    for (OrderId id = 1; id <= 1000; id += 2) REQUIRE(m.erase(id * 7));
+    REQUIRE(!m.erase(7));
+    REQUIRE_EQ(m.size(), 500u);
+    bool all_found = true;
+    for (OrderId id = 1; id <= 1000; ++id) {
+        const int *v = m.find(id * 7);
+        all_found &= (id % 2 == 0) ? (v && *v == static_cast<int>(id)) : (v == nullptr);
+    }
+    REQUIRE(all_found);
+
+    // The empty marker is never a key.
+    FlatIdMap<int> one(4);
+    REQUIRE(one.insert(1, 1));
+    REQUIRE(one.find(kNoOrderId) == nullptr);
+    REQUIRE(!one.erase(kNoOrderId));
+    REQUIRE(!one.insert(kNoOrderId, 0));
+    REQUIRE_EQ(one.size(), 1u);
+
+    OrderBook ob;
+    REQUIRE(ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1}).has_value());
+    REQUIRE(!ob.post_passive({1, Side::Sell, OrdType::Limit, 105, 10, 2}).has_value());
+    REQUIRE_EQ(ob.best_ask()->first, 100);
+    REQUIRE(!ob.post_passive({kNoOrderId, Side::Sell, OrdType::Limit, 101, 10, 3}).has_value());
+    // A live id is refused before it can trade.
+    REQUIRE(!ob.add_limit({1, Side::Buy, OrdType::Limit, 100, 15, 4}, [](const Trade &) { REQUIRE(false); }));
+    REQUIRE_EQ(ob.best_ask()->second, 10);
+    REQUIRE(!ob.best_bid().has_value());
+
+    DenseOrderBook dense;
+    REQUIRE(dense.post_passive({2, Side::Buy, OrdType::Limit, 0, 10, 1}).has_value());
+    REQUIRE(!dense.cancel(kNoOrderId));
+    REQUIRE_EQ(dense.best_bid()->second, 10);
+}
+
+void check_dense_id_index() {
+    BookConfig cfg;
+    cfg.base_id = 1000;
+    DenseIdIndex<int> idx(cfg);
+    using Idx = DenseIdIndex<int>;
+    REQUIRE(!idx.insert(999, 0));
+    for (OrderId id = 1000; id < 1000 + 3 * Idx::kPageSize; ++id) REQUIRE(idx.insert(id, static_cast<int>(id)));
+    REQUIRE_EQ(idx.pages_in_use(), 3u);
+    for (OrderId id = 1000; id < 1000 + 2 * Idx::kPageSize; ++id) idx.erase(id);
+    REQUIRE_EQ(idx.pages_in_use(), 1u);
+    REQUIRE(idx.find(1000) == nullptr);
+    REQUIRE(!idx.insert(1000, 0));
+    REQUIRE_EQ(*idx.find(1000 + 2 * Idx::kPageSize), static_cast<int>(1000 + 2 * Idx::kPageSize));
+
+    // One long-lived id pins only its own page; ids far past the window are refused.
+    DenseIdIndex<int> pinned(BookConfig{});
+    REQUIRE(pinned.insert(0, 0));
+    for (OrderId id = 1; id < 64 * Idx::kPageSize; ++id) {
+        pinned.insert(id, 1);
+        pinned.erase(id);
+    }
+    REQUIRE_EQ(pinned.pages_in_use(), 2u);
+    REQUIRE(pinned.find(0) != nullptr);
+    REQUIRE(!pinned.insert(OrderId{1} << 36, 0));
+    REQUIRE(pinned.insert(64 * Idx::kPageSize + 5, 2));
+    REQUIRE(pinned.erase(0));
+    REQUIRE_EQ(pinned.pages_in_use(), 1u);
+
+    BasicOrderBook<MapLadder, DenseIdIndex> ob;
+    ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 101, 10, 2});
+    REQUIRE(ob.cancel(1));
+    REQUIRE(!ob.cancel(1));
+    auto t = ob.modify(2, 102, std::nullopt, 3);
+    REQUIRE_EQ(ob.best_ask()->first, 102);
+
+    // A crossing reprice of the only live id on its page keeps the entry.
+    BasicOrderBook<ArrayLadder, DenseIdIndex> dense;
+    dense.post_passive({1, Side::Buy, OrdType::Limit, 100, 10, 1});
+    dense.post_passive({5000, Side::Sell, OrdType::Limit, 105, 3, 2});
+    REQUIRE_EQ(dense.modify(1, 105, std::nullopt, 3).size(), 1u);
+    REQUIRE_EQ(dense.best_bid()->first, 105);
+    REQUIRE_EQ(dense.best_bid()->second, 7);
+    REQUIRE(dense.cancel(1));
+}
+
+void check_level_bitmap() {
+    const size_t n = 300000;
+    LevelBitmap bm(n);
+    std::vector<size_t> marks = {0, 63, 64, 4095, 4096, 262143, 262144, 299999};
+    for (size_t i: marks) bm.set(i);
+    REQUIRE_EQ(bm.next_at_or_after(0), 0u);
+    REQUIRE_EQ(bm.next_at_or_after(1), 63u);
+    REQUIRE_EQ(bm.next_at_or_after(65), 4095u);
+    REQUIRE_EQ(bm.next_at_or_after(4097), 262143u);
+    REQUIRE_EQ(bm.prev_at_or_before(262142), 4096u);
+    REQUIRE_EQ(bm.prev_at_or_before(n - 1), 299999u);
+    bm.reset(299999);
+    REQUIRE_EQ(bm.next_at_or_after(262145), LevelBitmap::npos);
+    bm.reset(0);
+    bm.reset(63);
+    REQUIRE_EQ(bm.prev_at_or_before(63), LevelBitmap::npos);
+    REQUIRE_EQ(bm.prev_at_or_before(64), 64u);
+
+    DenseOrderBook ob(BookConfig{0, 100000, 1});
+    for (Price px = 10000; px <= 20000; px += 1000) ob.post_passive({static_cast<OrderId>(px), Side::Sell, OrdType::Limit, px, 1, 1});
+    auto t = ob.add_market({1, Side::Buy, OrdType::Market, 0, 10, 2});
+    REQUIRE_EQ(t.size(), 10u);
+    REQUIRE_EQ(t.back().px, 19000);
+    REQUIRE_EQ(ob.best_ask()->first, 20000);
+}
+
+// A modify whose target cannot rest is refused and the order keeps its place.
+void check_modify_reject() {
+    DenseOrderBook ob(BookConfig{90, 120, 2});
+    REQUIRE(ob.post_passive({1, Side::Buy, OrdType::Limit, 100, 10, 1}).has_value());
+    REQUIRE(ob.post_passive({2, Side::Sell, OrdType::Limit, 110, 5, 2}).has_value());
+    REQUIRE(!ob.modify(1, Price{101}, std::nullopt, 3, [](const Trade &) {}));
+    REQUIRE(!ob.modify(1, Price{130}, std::nullopt, 3, [](const Trade &) {}));
+    REQUIRE(!ob.modify(1, Price{111}, std::nullopt, 3, [](const Trade &) {}));
+    REQUIRE_EQ(ob.best_bid()->first, 100);
+    REQUIRE_EQ(ob.best_bid()->second, 10);
+    REQUIRE_EQ(ob.best_ask()->second, 5);
+
+    CompactOrderBook cb;
+    REQUIRE(cb.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1}).has_value());
+    REQUIRE(!cb.modify(1, std::nullopt, Qty{1} << 40, 2, [](const Trade &) {}));
+    REQUIRE(!cb.modify(1, Price{99}, Qty{1} << 40, 2, [](const Trade &) {}));
+    REQUIRE_EQ(cb.best_ask()->second, 10);
+    REQUIRE(cb.cancel(1));
+}
+
+void check_compact_layout() {
+    CompactOrderBook ob(BookConfig{1000, 2000, 5});
+    REQUIRE(!ob.post_passive({1, Side::Sell, OrdType::Limit, 1500, Qty{1} << 40, 1}).has_value());
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 1505, 70, 2});
+    ob.post_passive({3, Side::Sell, OrdType::Limit, 1500, 30, 3});
+    auto t = ob.add_limit({4, Side::Buy, OrdType::Limit, 1505, 50, 4});
+    REQUIRE_EQ(t.size(), 2u);
+    REQUIRE_EQ(t[0].px, 1500);
+    REQUIRE_EQ(t[1].px, 1505);
+    REQUIRE_EQ(t[1].qty, 20);
+    REQUIRE_EQ(ob.best_ask()->second, 50);
+}
+
+void check_trade_sink() {
+    OrderBook ob;
+    ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 101, 10, 2});
+    ob.post_passive({3, Side::Buy, OrdType::Limit, 98, 10, 3});
+    Qty filled = 0;
+    size_t n = 0;
+    auto sink = [&](const Trade &t) { filled += t.qty; ++n; };
+    ob.add_limit({4, Side::Buy, OrdType::Limit, 100, 15, 4}, sink);
+    REQUIRE_EQ(n, 1u);
+    REQUIRE_EQ(filled, 10);
+    REQUIRE(ob.modify(3, 101, std::nullopt, 5, sink));
+    REQUIRE_EQ(n, 2u);
+    REQUIRE_EQ(filled, 20);
+    REQUIRE(!ob.modify(42, 101, std::nullopt, 6, sink));
+    ob.add_market({5, Side::Sell, OrdType::Market, 0, 3, 7}, sink);
+    REQUIRE_EQ(filled, 23);
+    REQUIRE_EQ(ob.best_bid()->first, 100);
+    REQUIRE_EQ(ob.best_bid()->second, 2);
+}
+
+void check_level_recycling() {
+    BookConfig cfg;
+    cfg.level_cache = 1;
+    OrderBook ob(cfg);
+    ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 101, 10, 2});
+    ob.add_market({3, Side::Buy, OrdType::Market, 0, 20, 3});
+    ob.post_passive({4, Side::Buy, OrdType::Limit, 99, 10, 4});
+    ob.post_passive({5, Side::Buy, OrdType::Limit, 98, 10, 5});
+    REQUIRE_EQ(ob.level_stats().levels_created, 4u);
+    REQUIRE_EQ(ob.level_stats().levels_reused, 0u);
+    ob.post_passive({6, Side::Sell, OrdType::Limit, 102, 10, 6});
+    REQUIRE_EQ(ob.level_stats().levels_reused, 1u);
+    REQUIRE_EQ(ob.best_ask()->first, 102);
+    REQUIRE_EQ(ob.best_ask()->second, 10);
+    ob.post_passive({7, Side::Sell, OrdType::Limit, 103, 10, 7});
+    REQUIRE_EQ(ob.level_stats().levels_created, 5u);
+}
+
+void check_whole_level_sweep() {
+    BookConfig cfg;
+    cfg.order_capacity = 4;
+    CompactOrderBook ob(cfg);
+    for (OrderId id = 1; id <= 4; ++id) ob.post_passive({id, Side::Buy, OrdType::Limit, 100, 5, id});
+    ob.post_passive({5, Side::Buy, OrdType::Limit, 99, 5, 5});
+    auto t = ob.add_limit({6, Side::Sell, OrdType::Limit, 99, 22, 6});
+    REQUIRE_EQ(t.size(), 5u);
+    REQUIRE_EQ(t[3].maker_id, 4u);
+    REQUIRE_EQ(t[4].qty, 2);
+    REQUIRE(!ob.cancel(2));
+    for (OrderId id = 7; id <= 10; ++id) REQUIRE(ob.post_passive({id, Side::Sell, OrdType::Limit, 101, 1, id}).has_value());
+    t = ob.add_market({11, Side::Buy, OrdType::Market, 0, 4, 11});
+    REQUIRE_EQ(t.size(), 4u);
+    REQUIRE_EQ(t[0].maker_id, 7u);
+    REQUIRE_EQ(t[3].maker_id, 10u);
+    REQUIRE_EQ(ob.best_bid()->second, 3);
+}
+
+template<class Book>
+void check_sweep_plan() {
+    Book ob(BookConfig{0, 1000, 1});
+    ob.post_passive({1, Side::Sell, OrdType::Limit, 101, 10, 1});
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 103, 20, 2});
+    ob.post_passive({3, Side::Sell, OrdType::Limit, 107, 30, 3});
+    ob.post_passive({4, Side::Buy, OrdType::Limit, 99, 15, 4});
+    ob.post_passive({5, Side::Buy, OrdType::Limit, 97, 25, 5});
+
+    auto p = ob.plan_sweep(Side::Buy, 25);
+    REQUIRE_EQ(p.fillable, 25);
+    REQUIRE_EQ(*p.last_px, 103);
+    p = ob.plan_sweep(Side::Buy, 100, 105);
+    REQUIRE_EQ(p.fillable, 30);
+    REQUIRE_EQ(*p.last_px, 103);
+    p = ob.plan_sweep(Side::Sell, 16);
+    REQUIRE_EQ(*p.last_px, 97);
+    p = ob.plan_sweep(Side::Sell, 10, 98);
+    REQUIRE_EQ(p.fillable, 10);
+    REQUIRE_EQ(*p.last_px, 99);
+    p = ob.plan_sweep(Side::Sell, 10, 100);
+    REQUIRE_EQ(p.fillable, 0);
+    REQUIRE(!p.last_px.has_value());
+
+    ob.add_market({6, Side::Buy, OrdType::Market, 0, 15, 6});
+    ob.cancel(5);
+    ob.modify(3, std::nullopt, 5, 7);
+    p = ob.plan_sweep(Side::Buy, 100);
+    REQUIRE_EQ(p.fillable, 20);
+    REQUIRE_EQ(*p.last_px, 107);
+    REQUIRE_EQ(ob.plan_sweep(Side::Sell, 100).fillable, 15);
+}
+
+template<class Book>
+void check_ioc_fok() {
+    Book ob;
+    ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 101, 10, 2});
+    ob.post_passive({3, Side::Sell, OrdType::Limit, 105, 10, 3});
+
+    auto t = ob.add_limit({4, Side::Buy, OrdType::Limit, 101, 25, 4, TimeInForce::Fok});
+    REQUIRE_EQ(t.size(), 0u);
+    REQUIRE_EQ(ob.best_ask()->second, 10);
+    size_t n = 0;
+    REQUIRE(!ob.add_market({5, Side::Buy, OrdType::Market, 0, 31, 5, TimeInForce::Fok}, [&](const Trade &) { ++n; }));
+    REQUIRE_EQ(n, 0u);
+
+    t = ob.add_limit({6, Side::Buy, OrdType::Limit, 101, 15, 6, TimeInForce::Fok});
+    REQUIRE_EQ(t.size(), 2u);
+    REQUIRE_EQ(ob.best_ask()->first, 101);
+    REQUIRE_EQ(ob.best_ask()->second, 5);
+
+    t = ob.add_limit({7, Side::Buy, OrdType::Limit, 101, 8, 7, TimeInForce::Ioc});
+    REQUIRE_EQ(t.size(), 1u);
+    REQUIRE_EQ(t[0].qty, 5);
+    REQUIRE(!ob.best_bid().has_value());
+    REQUIRE(!ob.cancel(7));
+}
+
+void check_post_only() {
+    DenseOrderBook ob(BookConfig{0, 1000, 5});
+    ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+    ob.post_passive({2, Side::Buy, OrdType::Limit, 90, 10, 2});
+
+    Order o{3, Side::Buy, OrdType::Limit, 100, 10, 3};
+    o.post_only = PostOnly::Reject;
+    size_t n = 0;
+    auto sink = [&](const Trade &) { ++n; };
+    REQUIRE(!ob.add_limit(o, sink));
+    REQUIRE_EQ(ob.best_bid()->first, 90);
+
+    o.post_only = PostOnly::Slide;
+    REQUIRE(ob.add_limit(o, sink));
+    REQUIRE_EQ(ob.best_bid()->first, 95);
+    REQUIRE_EQ(ob.best_ask()->second, 10);
+
+    Order s{4, Side::Sell, OrdType::Limit, 95, 10, 4};
+    s.post_only = PostOnly::Reject;
+    REQUIRE(!ob.add_limit(s, sink));
+    s.px = 90;
+    s.post_only = PostOnly::Slide;
+    REQUIRE(ob.add_limit(s, sink));
+    REQUIRE_EQ(ob.best_ask()->first, 100);
+    REQUIRE_EQ(ob.best_ask()->second, 20);
+    REQUIRE_EQ(n, 0u);
+    REQUIRE(ob.cancel(4));
+
+    // Post-only goes through the same id and time-in-force checks as any limit.
+    Order stop{7, Side::Buy, OrdType::Stop, 0, 5, 5};
+    stop.stop_px = 200;
+    REQUIRE(ob.add_stop(stop).empty());
+    Order p{7, Side::Buy, OrdType::Limit, 50, 5, 6};
+    p.post_only = PostOnly::Reject;
+    REQUIRE(!ob.add_limit(p, sink));
+    p.id = 8;
+    for (TimeInForce tif: {TimeInForce::Ioc, TimeInForce::Fok}) {
+        p.tif = tif;
+        REQUIRE(!ob.add_limit(p, sink));
+    }
+    ob.advance_clock(100, [](OrderId) {});
+    p.tif = TimeInForce::Gtd;
+    p.expire_ts = 100;
+    REQUIRE(!ob.add_limit(p, sink));
+    p.expire_ts = 200;
+    REQUIRE(ob.add_limit(p, sink));
+    REQUIRE(ob.cancel(8));
+    REQUIRE(ob.cancel(7));
+    REQUIRE_EQ(ob.best_bid()->first, 95);
+}
+
+template<class Book>
+void check_stops() {
+    Book ob;
+    ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 5, 1});
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 101, 5, 2});
+    ob.post_passive({3, Side::Sell, OrdType::Limit, 102, 10, 3});
+    ob.post_passive({4, Side::Buy, OrdType::Limit, 95, 10, 4});
+
+    Order stop{10, Side::Buy, OrdType::Stop, 0, 5, 10};
+    stop.stop_px = 101;
+    Order stop_limit{11, Side::Buy, OrdType::StopLimit, 101, 5, 11};
+    stop_limit.stop_px = 100;
+    Order sell_stop{12, Side::Sell, OrdType::Stop, 0, 5, 12};
+    sell_stop.stop_px = 90;
+    REQUIRE(ob.add_stop(stop).empty());
+    REQUIRE(ob.add_stop(stop_limit).empty());
+    REQUIRE(ob.add_stop(sell_stop).empty());
+    REQUIRE(!ob.last_trade_px().has_value());
+
+    // The print at 100 fires the stop-limit, whose fill at 101 fires the stop.
+    auto tr = ob.add_market({20, Side::Buy, OrdType::Market, 0, 5, 20});
+    REQUIRE_EQ(tr.size(), 3u);
+    REQUIRE_EQ(tr[1].taker_id, 11u);
+    REQUIRE_EQ(tr[1].px, 101);
+    REQUIRE_EQ(tr[2].taker_id, 10u);
+    REQUIRE_EQ(tr[2].px, 102);
+    REQUIRE_EQ(ob.best_ask()->second, 5);
+    REQUIRE_EQ(*ob.last_trade_px(), 102);
+
+    REQUIRE(ob.cancel(12));
+    REQUIRE(!ob.cancel(12));
+
+    // Already through its stop: released on arrival.
+    Order late{13, Side::Sell, OrdType::Stop, 0, 5, 13};
+    late.stop_px = 105;
+    tr = ob.add_stop(late);
+    REQUIRE_EQ(tr.size(), 1u);
+    REQUIRE_EQ(tr[0].px, 95);
+}
+
+template<class Book>
+void check_iceberg() {
+    Book ob;
+    Order ice{1, Side::Sell, OrdType::Limit, 100, 25, 1};
+    ice.display = 10;
+    ob.post_passive(ice);
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 100, 5, 2});
+    REQUIRE_EQ(ob.best_ask()->second, 15);
+    REQUIRE(ob.can_fill(Side::Buy, 30, 100));
+    REQUIRE(!ob.can_fill(Side::Buy, 31, 100));
+
+    // The spent slice replenishes behind order 2.
+    auto tr = ob.add_limit({3, Side::Buy, OrdType::Limit, 100, 12, 3});
+    REQUIRE_EQ(tr.size(), 2u);
+    REQUIRE_EQ(tr[0].maker_id, 1u);
+    REQUIRE_EQ(tr[0].qty, 10);
+    REQUIRE_EQ(tr[1].maker_id, 2u);
+    REQUIRE_EQ(tr[1].qty, 2);
+    REQUIRE_EQ(ob.best_ask()->second, 13);
+
+    // Reduced from the reserve: 10 shown, 2 hidden.
+    REQUIRE(ob.modify(1, std::nullopt, 12, 4).empty());
+    REQUIRE_EQ(ob.best_ask()->second, 13);
+
+    tr = ob.add_market({4, Side::Buy, OrdType::Market, 0, 20, 5});
+    REQUIRE_EQ(tr.size(), 3u);
+    REQUIRE_EQ(tr[1].maker_id, 1u);
+    REQUIRE_EQ(tr[2].maker_id, 1u);
+    REQUIRE_EQ(tr[2].qty, 2);
+    REQUIRE(!ob.best_ask().has_value());
+    REQUIRE(!ob.cancel(1));
+
+    ice.id = 5;
+    ice.qty = 30;
+    ob.post_passive(ice);
+    REQUIRE(ob.cancel(5));
+    REQUIRE(!ob.best_ask().has_value());
+    REQUIRE_EQ(ob.plan_sweep(Side::Buy, 1).fillable, 0);
+}
+
+template<class Book>
+void check_pegs() {
+    Book ob;
+    ob.post_passive({1, Side::Buy, OrdType::Limit, 98, 10, 1});
+    ob.post_passive({2, Side::Sell, OrdType::Limit, 102, 10, 2});
+
+    Order mid{10, Side::Buy, OrdType::Limit, 0, 5, 10};
+    mid.peg = PegType::Mid;
+    Order primary{11, Side::Buy, OrdType::Limit, 0, 5, 11};
+    primary.peg = PegType::Primary;
+    primary.peg_offset = 1;
+    Order join{12, Side::Sell, OrdType::Limit, 0, 5, 12};
+    join.peg = PegType::Primary;
+    REQUIRE(ob.add_peg(mid));
+    REQUIRE(ob.add_peg(primary));
+    REQUIRE(ob.add_peg(join));
+    REQUIRE(!ob.add_peg(join));
+    REQUIRE_EQ(*ob.peg_price(10), 100);
+    REQUIRE_EQ(*ob.peg_price(11), 97);
+    REQUIRE_EQ(ob.best_bid()->first, 98);
+
+    // The mid peg is better than the lit bid; the primary peg is not crossed.
+    auto tr = ob.add_limit({3, Side::Sell, OrdType::Limit, 99, 7, 3});
+    REQUIRE_EQ(tr.size(), 1u);
+    REQUIRE_EQ(tr[0].maker_id, 10u);
+    REQUIRE_EQ(tr[0].px, 100);
+    REQUIRE_EQ(ob.best_ask()->first, 99);
+    REQUIRE_EQ(*ob.peg_price(12), 99);
+
+    REQUIRE(ob.cancel(1));
+    REQUIRE(!ob.peg_price(11).has_value());
+
+    // Lit goes first at an equal price and the joining peg fills behind it.
+    tr = ob.add_market({4, Side::Buy, OrdType::Market, 0, 20, 4});
+    REQUIRE_EQ(tr.size(), 3u);
+    REQUIRE_EQ(tr[0].maker_id, 3u);
+    REQUIRE_EQ(tr[1].maker_id, 12u);
+    REQUIRE_EQ(tr[1].px, 99);
+    REQUIRE_EQ(tr[1].qty, 5);
+    REQUIRE_EQ(tr[2].maker_id, 2u);
+    REQUIRE(!ob.cancel(12));
+    REQUIRE(ob.cancel(11));
+    REQUIRE(!ob.cancel(10));
+
+    // A primary peg is reached once the lit queue at its price is gone.
+    Book pb(BookConfig{0, 1000, 2});
+    pb.post_passive({1, Side::Sell, OrdType::Limit, 102, 10, 1});
+    Order ask{2, Side::Sell, OrdType::Limit, 0, 5, 2};
+    ask.peg = PegType::Primary;
+    ask.peg_offset = 3;
+    REQUIRE(!pb.add_peg(ask));
+    ask.peg_offset = 0;
+    REQUIRE(pb.add_peg(ask));
+    tr = pb.add_market({3, Side::Buy, OrdType::Market, 0, 15, 3});
+    REQUIRE_EQ(tr.size(), 2u);
+    REQUIRE_EQ(tr[1].maker_id, 2u);
+    REQUIRE_EQ(tr[1].px, 102);
+    REQUIRE_EQ(tr[1].qty, 5);
+    REQUIRE(!pb.cancel(2));
+}
+
+void check_timing_wheel() {
+    TimingWheel wheel(8);
+    std::mt19937_64 rng(7);
+    std::vector<Ts> at(2000);
+    for (size_t i = 0; i < at.size(); ++i) {
+        at[i] = rng() % (i % 4 == 0 ? (Ts{1} << 52) : 100000);
+        wheel.schedule(i, at[i]);
+    }
+    std::vector<TimingWheel::Entry> out;
+    std::vector<int> fired(at.size(), 0);
+    Ts now = 0;
+    while (!wheel.empty()) {
+        now += 1 + rng() % (now < 100000 ? 5000 : (Ts{1} << 38));
+        out.clear();
+        wheel.advance(now, out);
+        for (const auto &e: out) {
+            REQUIRE(e.at <= now);
+            REQUIRE(now - e.at < (now < 100000 ? 5008 : (Ts{1} << 38) + 8));
+            ++fired[e.id];
+        }
+    }
+    for (int f: fired) REQUIRE_EQ(f, 1);
+}
+
+template<class Book>
+void check_expiry() {
+    BookConfig cfg;
+    cfg.session_close = 1000;
+    Book ob(cfg);
+    auto gtd = [](OrderId id, Price px, Qty qty, Ts expire) {
+        Order o{id, Side::Buy, OrdType::Limit, px, qty, id};
+        o.tif = TimeInForce::Gtd;
+        o.expire_ts = expire;
+        return o;
+    };
+    REQUIRE(ob.add_limit(gtd(1, 100, 5, 50)).empty());
+    Order day{2, Side::Buy, OrdType::Limit, 99, 5, 2};
+    day.tif = TimeInForce::Day;
+    REQUIRE(ob.add_limit(day).empty());
+    ob.post_passive({3, Side::Buy, OrdType::Limit, 98, 5, 3});
+    ob.post_passive(gtd(4, 97, 5, 5000));
+    ob.post_passive(gtd(5, 96, 5, 70));
+    ob.post_passive(gtd(6, 101, 3, 60));
+
+    // Repriced orders keep their expiry; filled ones leave a stale wheel entry.
+    REQUIRE(ob.modify(5, 95, 8, 10).empty());
+    REQUIRE_EQ(ob.add_market({7, Side::Sell, OrdType::Market, 0, 3, 11}).size(), 1u);
+
+    REQUIRE(ob.advance_clock(49).empty());
+    REQUIRE(ob.advance_clock(60) == std::vector<OrderId>{1});
+    REQUIRE(ob.advance_clock(75) == std::vector<OrderId>{5});
+    REQUIRE(ob.advance_clock(1000) == std::vector<OrderId>{2});
+    REQUIRE(ob.advance_clock(5000) == std::vector<OrderId>{4});
+    REQUIRE_EQ(ob.best_bid()->first, 98);
+    REQUIRE(!ob.add_limit(gtd(8, 98, 5, 4000), [](const Trade &) {}));
+    REQUIRE(!ob.add_limit(day, [](const Trade &) {}));
+}
+
+template<class Book>
+void check_mass_cancel() {
+    Book ob;
+    auto order = [](OrderId id, Side s, Price px, Qty qty, OwnerId owner) {
+        Order o{id, s, OrdType::Limit, px, qty, id};
+        o.owner = owner;
+        return o;
+    };
+    ob.post_passive(order(1, Side::Buy, 100, 5, 1));
+    ob.post_passive(order(2, Side::Buy, 99, 5, 1));
+    ob.post_passive(order(3, Side::Buy, 100, 7, 2));
+    ob.post_passive(order(4, Side::Sell, 105, 5, 2));
+    ob.post_passive(order(5, Side::Sell, 106, 5, 1));
+    Order ice = order(6, Side::Sell, 107, 10, 2);
+    ice.display = 2;
+    ob.post_passive(ice);
+    Order stop = order(7, Side::Sell, 0, 5, 1);
+    stop.type = OrdType::Stop;
+    stop.stop_px = 90;
+    ob.add_stop(stop);
+    Order peg = order(8, Side::Buy, 0, 5, 2);
+    peg.peg = PegType::Primary;
+    ob.add_peg(peg);
+
+    std::vector<OrderId> ids;
+    auto sink = [&ids](OrderId id) { ids.push_back(id); };
+    REQUIRE_EQ(ob.cancel_owner(1, sink), 4u);
+    std::sort(ids.begin(), ids.end());
+    REQUIRE(ids == (std::vector<OrderId>{1, 2, 5, 7}));
+    REQUIRE_EQ(ob.best_bid()->second, 7);
+    REQUIRE(!ob.cancel(1));
+
+    ids.clear();
+    REQUIRE_EQ(ob.cancel_range(Side::Sell, 106, 99, sink), 0u);
+    REQUIRE(ids.empty());
+    REQUIRE_EQ(ob.cancel_range(Side::Sell, 106, 200, sink), 1u);
+    REQUIRE(ids == std::vector<OrderId>{6});
+    REQUIRE(ob.can_fill(Side::Buy, 5, std::nullopt));
+    REQUIRE(!ob.can_fill(Side::Buy, 6, std::nullopt));
+
+    ids.clear();
+    REQUIRE_EQ(ob.cancel_side(Side::Buy, sink), 2u);
+    REQUIRE(!ob.best_bid().has_value());
+    REQUIRE(!ob.cancel(8));
+    REQUIRE_EQ(ob.cancel_all(sink), 1u);
+    REQUIRE(!ob.best_ask().has_value());
+
+    ob.post_passive(order(9, Side::Sell, 105, 5, 3));
+    REQUIRE_EQ(ob.add_market({10, Side::Buy, OrdType::Market, 0, 5, 10}).size(), 1u);
+}
+
+template<class Book>
+void check_stp() {
+    auto setup = [](Book &ob) {
+        Order a{1, Side::Sell, OrdType::Limit, 100, 5, 1};
+        a.owner = 7;
+        Order b{2, Side::Sell, OrdType::Limit, 100, 5, 2};
+        b.owner = 8;
+        ob.post_passive(a);
+        ob.post_passive(b);
+    };
+    auto taker = [](OrderId id, Qty qty, Stp mode) {
+        Order o{id, Side::Buy, OrdType::Limit, 100, qty, id};
+        o.owner = 7;
+        o.stp = mode;
+        return o;
+    };
+
+    {
+        Book ob;
+        setup(ob);
+        REQUIRE(ob.add_limit(taker(10, 8, Stp::CancelNewest)).empty());
+        REQUIRE(ob.stp_cancelled().empty());
+        REQUIRE_EQ(ob.best_ask()->second, 10);
+        REQUIRE(!ob.best_bid().has_value());
+    }
+    {
+        Book ob;
+        setup(ob);
+        auto tr = ob.add_limit(taker(10, 10, Stp::CancelOldest));
+        REQUIRE_EQ(tr.size(), 1u);
+        REQUIRE_EQ(tr[0].maker_id, 2u);
+        REQUIRE(ob.stp_cancelled() == std::vector<OrderId>{1});
+        REQUIRE_EQ(ob.best_bid()->second, 5);
+        REQUIRE(!ob.cancel(1));
+        Order post{20, Side::Sell, OrdType::Limit, 110, 5, 20};
+        post.post_only = PostOnly::Reject;
+        REQUIRE(ob.add_limit(post, [](const Trade &) {}));
+        REQUIRE(ob.stp_cancelled().empty());
+    }
+    {
+        Book ob;
+        setup(ob);
+        REQUIRE(ob.add_limit(taker(10, 8, Stp::CancelBoth)).empty());
+        REQUIRE(ob.stp_cancelled() == std::vector<OrderId>{1});
+        REQUIRE_EQ(ob.best_ask()->second, 5);
+        REQUIRE(!ob.best_bid().has_value());
+    }
+    {
+        Book ob;
+        setup(ob);
+        REQUIRE(ob.add_limit(taker(10, 3, Stp::Decrement)).empty());
+        REQUIRE_EQ(ob.best_ask()->second, 7);
+        auto tr = ob.add_limit(taker(11, 8, Stp::Decrement));
+        REQUIRE_EQ(tr.size(), 1u);
+        REQUIRE_EQ(tr[0].qty, 5);
+        REQUIRE(ob.stp_cancelled() == std::vector<OrderId>{1});
+        REQUIRE_EQ(ob.best_bid()->second, 1);
+    }
+    {
+        Book ob;
+        setup(ob);
+        REQUIRE_EQ(ob.add_limit(taker(10, 10, Stp::Off)).size(), 2u);
+    }
+    {
+        // FOK counts only depth the taker can actually reach past its own orders.
+        Book ob;
+        setup(ob);
+        Order fok = taker(10, 10, Stp::CancelOldest);
+        fok.tif = TimeInForce::Fok;
+        REQUIRE(!ob.add_limit(fok, [](const Trade &) {}));
+        fok.stp = Stp::CancelNewest;
+        fok.qty = 5;
+        REQUIRE(!ob.add_limit(fok, [](const Trade &) {}));
+        REQUIRE_EQ(ob.best_ask()->second, 10);
+        fok.stp = Stp::CancelOldest;
+        auto tr = ob.add_limit(fok);
+        REQUIRE_EQ(tr.size(), 1u);
+        REQUIRE_EQ(tr[0].maker_id, 2u);
+        REQUIRE(!ob.best_ask().has_value());
+    }
+    {
+        // A mid peg of the taker's owner at 100 is resolved, not traded.
+        Book ob;
+        Order bid{1, Side::Buy, OrdType::Limit, 98, 5, 1};
+        bid.owner = 9;
+        Order ask{2, Side::Sell, OrdType::Limit, 102, 5, 2};
+        ask.owner = 8;
+        ob.post_passive(bid);
+        ob.post_passive(ask);
+        Order peg{3, Side::Sell, OrdType::Limit, 0, 5, 3};
+        peg.peg = PegType::Mid;
+        peg.owner = 7;
+        REQUIRE(ob.add_peg(peg));
+        REQUIRE(ob.add_limit(taker(10, 3, Stp::CancelNewest)).empty());
+        REQUIRE(!ob.best_bid() || ob.best_bid()->first == 98);
+        REQUIRE(ob.add_limit(taker(11, 2, Stp::Decrement)).empty());
+        REQUIRE_EQ(*ob.peg_price(3), 100);
+        REQUIRE(ob.add_limit(taker(12, 4, Stp::CancelOldest)).empty());
+        REQUIRE(ob.stp_cancelled() == std::vector<OrderId>{3});
+        REQUIRE(!ob.cancel(3));
+        REQUIRE_EQ(ob.best_bid()->first, 100);
+    }
+}
+
+void check_pro_rata() {
+    auto fills = [](auto &&ob, Qty qty) {
+        ob.post_passive({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+        ob.post_passive({2, Side::Sell, OrdType::Limit, 100, 30, 2});
+        ob.post_passive({3, Side::Sell, OrdType::Limit, 100, 60, 3});
+        std::vector<Qty> out;
+        for (const Trade &t: ob.add_limit({4, Side::Buy, OrdType::Limit, 100, qty, 4})) out.push_back(t.qty);
+        return out;
+    };
+    REQUIRE(fills(ProRataOrderBook{}, 50) == (std::vector<Qty>{5, 15, 30}));
+    // Rounding leftovers go in queue order.
+    REQUIRE(fills(ProRataOrderBook{}, 7) == (std::vector<Qty>{1, 2, 4}));
+    REQUIRE(fills(BasicOrderBook<MapLadder, FlatIdMap, WideLayout, ProRataTopOrder>{}, 50) == (std::vector<Qty>{10, 14, 26}));
+
+    ProRataOrderBook ob;
+    REQUIRE(fills(ob, 99) == (std::vector<Qty>{10, 30, 59}));
+    REQUIRE_EQ(ob.best_ask()->second, 1);
+    REQUIRE(!ob.cancel(1));
+    REQUIRE(ob.cancel(3));
+}
+
+template<class Book>
+void check_auction() {
+    Book ob;
+    ob.begin_call();
+    REQUIRE(ob.phase() == Phase::Call);
+    for (Order o: {Order{1, Side::Buy, OrdType::Limit, 100, 10, 1}, Order{2, Side::Buy, OrdType::Limit, 102, 5, 2},
+                   Order{3, Side::Buy, OrdType::Limit, 99, 8, 3}, Order{4, Side::Sell, OrdType::Limit, 98, 6, 4},
+                   Order{5, Side::Sell, OrdType::Limit, 101, 7, 5}, Order{6, Side::Sell, OrdType::Limit, 103, 4, 6}}) {
+        REQUIRE(ob.add_limit(o).empty());
+    }
+    REQUIRE(!ob.add_market({7, Side::Buy, OrdType::Market, 0, 5, 7}, [](const Trade &) {}));
+    Order ioc{8, Side::Buy, OrdType::Limit, 103, 5, 8};
+    ioc.tif = TimeInForce::Ioc;
+    REQUIRE(!ob.add_limit(ioc, [](const Trade &) {}));
+    REQUIRE_EQ(ob.best_bid()->first, 102);
+    REQUIRE_EQ(ob.best_ask()->first, 98);
+    // Orders entered in the call still pass the id and expiry checks.
+    Order stop{20, Side::Buy, OrdType::Stop, 0, 5, 9};
+    stop.stop_px = 200;
+    REQUIRE(ob.add_stop(stop).empty());
+    REQUIRE(!ob.add_limit({20, Side::Buy, OrdType::Limit, 90, 5, 9}, [](const Trade &) {}));
+    ob.advance_clock(50, [](OrderId) {});
+    Order gtd{21, Side::Buy, OrdType::Limit, 90, 5, 9};
+    gtd.tif = TimeInForce::Gtd;
+    gtd.expire_ts = 50;
+    REQUIRE(!ob.add_limit(gtd, [](const Trade &) {}));
+    REQUIRE(ob.cancel(20));
+
+    // 98..100 all execute 6; 100 leaves the smallest surplus.
+    auto q = ob.indicative_uncross();
+    REQUIRE_EQ(q->px, 100);
+    REQUIRE_EQ(q->volume, 6);
+    REQUIRE_EQ(q->surplus, 9);
+
+    auto tr = ob.uncross();
+    REQUIRE(ob.phase() == Phase::Continuous);
+    REQUIRE_EQ(tr.size(), 2u);
+    REQUIRE_EQ(tr[0].taker_id, 2u);
+    REQUIRE_EQ(tr[0].maker_id, 4u);
+    REQUIRE_EQ(tr[0].qty, 5);
+    REQUIRE_EQ(tr[1].taker_id, 1u);
+    REQUIRE_EQ(tr[1].px, 100);
+    REQUIRE_EQ(ob.best_bid()->second, 9);
+    REQUIRE_EQ(ob.best_ask()->first, 101);
+    REQUIRE_EQ(*ob.last_trade_px(), 100);
+    REQUIRE(!ob.indicative_uncross().has_value());
+    REQUIRE_EQ(ob.add_market({9, Side::Buy, OrdType::Market, 0, 3, 9}).size(), 1u);
+}
+
+// A small ring forces wrap-around, full-ring rejects and partial drains; the
+// second runs producer and consumer on separate threads.
+void check_spsc_ring() {
+    SpscRing<uint64_t> r(5);
+    REQUIRE_EQ(r.capacity(), 8u);
+    for (uint64_t i = 0; i < 8; ++i) REQUIRE(r.try_push(i));
+    REQUIRE(!r.try_push(8));
+    REQUIRE_EQ(r.drain([](uint64_t) {}), 0u);
+    r.publish();
+    uint64_t expect = 0;
+    REQUIRE_EQ(r.drain([&](uint64_t v) { REQUIRE_EQ(v, expect++); }, 3), 3u);
+    REQUIRE(r.try_push(8));
+    r.publish();
+    REQUIRE_EQ(r.drain([&](uint64_t v) { REQUIRE_EQ(v, expect++); }), 6u);
+    REQUIRE(r.empty());
+
+    SpscRing<uint64_t> q(1024);
+    const uint64_t n = 200000;
+    uint64_t got = 0;
+    bool ordered = true;
+    std::thread consumer([&] {
+        while (got < n) {
+            if (!q.drain([&](uint64_t v) { ordered &= v == got++; })) std::this_thread::yield();
+        }
+    });
+    for (uint64_t i = 0; i < n; ++i) {
+        while (!q.try_push(i)) {
+            q.publish();
+            std::this_thread::yield();
+        }
+        if (i % 16 == 0) q.publish();
+    }
+    q.publish();
+    consumer.join();
+    REQUIRE(ordered);
+    REQUIRE_EQ(got, n);
+}
+
+// Each symbol sees the same flow; every book must end where a standalone book does.
+void check_engine() {
+    struct Count {
+        uint64_t qty{0};
+        void on_trade(SymbolId, const Trade &t) { qty += static_cast<uint64_t>(t.qty); }
+    };
+    EngineConfig cfg;
+    cfg.workers = 3;
+    cfg.symbols = 8;
+    cfg.pin = false;
+    cfg.book.order_capacity = 64;
+    MatchingEngine<OrderBook, Count> eng(cfg);
+    REQUIRE(!eng.submit(Command{}));
+    eng.start();
+
+    OrderBook ref(cfg.book);
+    std::vector<Command> flow;
+    auto limit = [&](OrderId id, Side s, Price px, Qty q) {
+        Command c;
+        c.order = {id, s, OrdType::Limit, px, q, id};
+        flow.push_back(c);
+    };
+    limit(1, Side::Sell, 100, 10);
+    limit(2, Side::Sell, 101, 10);
+    limit(3, Side::Buy, 99, 5);
+    limit(4, Side::Buy, 101, 15);
+    Command cx;
+    cx.kind = Command::Kind::Cancel;
+    cx.order.id = 3;
+    flow.push_back(cx);
+    Command md;
+    md.kind = Command::Kind::Modify;
+    md.order = {2, Side::Sell, OrdType::Limit, 0, 0, 6};
+    md.new_qty = 2;
+    flow.push_back(md);
+    Command mk;
+    mk.kind = Command::Kind::Market;
+    mk.order = {7, Side::Buy, OrdType::Market, 0, 1, 7};
+    flow.push_back(mk);
+
+    for (const Command &c: flow) {
+        for (SymbolId s = 0; s < cfg.symbols; ++s) {
+            Command r = c;
+            r.symbol = s;
+            REQUIRE(eng.submit(r));
+        }
+    }
+    Command bad;
+    bad.symbol = 8;
+    REQUIRE(!eng.submit(bad));
+    ref.add_limit({1, Side::Sell, OrdType::Limit, 100, 10, 1});
+    ref.add_limit({2, Side::Sell, OrdType::Limit, 101, 10, 2});
+    ref.add_limit({3, Side::Buy, OrdType::Limit, 99, 5, 3});
+    ref.add_limit({4, Side::Buy, OrdType::Limit, 101, 15, 4});
+    ref.cancel(3);
+    ref.modify(2, std::nullopt, Qty{2}, 6);
+    ref.add_market({7, Side::Buy, OrdType::Market, 0, 1, 7});
+
+    eng.flush();
+    uint64_t commands = 0, qty = 0;
+    for (std::size_t w = 0; w < eng.workers(); ++w) {
+        commands += eng.stats(w).commands;
+        REQUIRE_EQ(eng.stats(w).rejects, 0u);
+        qty += eng.listener(w).qty;
+    }
+    REQUIRE_EQ(commands, flow.size() * cfg.symbols);
+    REQUIRE_EQ(qty, 16u * cfg.symbols);
+    for (SymbolId s = 0; s < cfg.symbols; ++s) {
+        REQUIRE(eng.book(s).best_ask() == ref.best_ask());
+        REQUIRE(eng.book(s).best_bid() == ref.best_bid());
+    }
+    eng.stop();
+    REQUIRE(!eng.submit(flow[0]));
+    REQUIRE_EQ(eng.book(7).best_ask()->second, 1);
+}
+
+template<class Book>
+void check_book() {
+    check_full_fill<Book>();
+    check_partial_then_post<Book>();
+    check_fifo<Book>();
+    check_modify_qty_down_in_place<Book>();
+    check_modify_relink<Book>();
+    check_market_buy<Book>();
+    check_cancel<Book>();
+}
+
 int main() {
-    check_full_fill();
-    check_partial_then_post();
-    check_fifo();
-    check_modify_qty_down_in_place();
-    check_market_buy();
-    check_cancel();
+    check_book<OrderBook>();
+    check_book<DenseOrderBook>();
+    check_book<BasicOrderBook<ArrayLadder, DenseIdIndex> >();
+    check_book<CompactOrderBook>();
+    check_dense_ladder();
+    check_pool_slots();
+    check_flat_id_map();
+    check_dense_id_index();
+    check_level_bitmap();
+    check_compact_layout();
+    check_modify_reject();
+    check_trade_sink();
+    check_level_recycling();
+    check_whole_level_sweep();
+    check_sweep_plan<OrderBook>();
+    check_sweep_plan<DenseOrderBook>();
+    check_ioc_fok<OrderBook>();
+    check_ioc_fok<DenseOrderBook>();
+    check_post_only();
+    check_stops<OrderBook>();
+    check_stops<DenseOrderBook>();
+    check_iceberg<OrderBook>();
+    check_iceberg<CompactOrderBook>();
+    check_pegs<OrderBook>();
+    check_pegs<DenseOrderBook>();
+    check_timing_wheel();
+    check_expiry<OrderBook>();
+    check_expiry<DenseOrderBook>();
+    check_mass_cancel<OrderBook>();
+    check_mass_cancel<DenseOrderBook>();
+    check_stp<OrderBook>();
+    check_stp<CompactOrderBook>();
+    check_pro_rata();
+    check_auction<OrderBook>();
+    check_auction<DenseOrderBook>();
+    check_spsc_ring();
+    check_engine();
 
     if (fails == 0) {
         std::cout << "[OK] smoke passed\n";
@@ -1,34 +1,54 @@
 #pragma once
-#include <map>
+#include <algorithm>
+#include <limits>
 #include <optional>
-#include <unordered_map>
-#include "price_level.hpp"
+#include <type_traits>
+#include "allocation.hpp"
+#include "auction.hpp"
+#include "id_index.hpp"
+#include "peg_book.hpp"
+#include "price_ladder.hpp"
+#include "stop_book.hpp"
+#include "timing_wheel.hpp"
 #include <vector>
 #include <cassert>
 
 namespace me {
-    class OrderBook {
+    template<template<Side> class Ladder, template<class> class Index = FlatIdMap, class Layout = WideLayout,
+        class Alloc = FifoAllocation>
+    class BasicOrderBook {
     public:
-        using Bids = std::map<Price, PriceLevel, std::greater<Price> >;
-        using Asks = std::map<Price, PriceLevel, std::less<Price> >;
-        using LevelIter = std::list<Order>::iterator;
+        using Bids = Ladder<Side::Buy>;
+        using Asks = Ladder<Side::Sell>;
 
         struct Handle {
-            Side side{};
             Price px{};
-            std::list<Order>::iterator it{};
+            Slot slot{kNilSlot};
+            Side side{};
         };
 
-        Handle post_passive(Order o) {
+        explicit BasicOrderBook(const BookConfig &cfg = {})
+            : bids_(cfg), asks_(cfg), pool_(cfg), by_id_(cfg), tick_(cfg.tick), pegs_(cfg),
+              session_close_(cfg.session_close), wheel_(cfg.expiry_resolution) {
+        }
+
+        std::optional<Handle> post_passive(Order o) {
             Side s = o.side;
             Price p = o.px;
             OrderId oid = o.id;
 
-            auto &lvl = ensure_level(s, p);
-            auto it = lvl.push(std::move(o));
-
-            Handle h{s, p, it};
-            by_id_[oid] = h;
+            if (!pool_.fits(o) || o.id == kNoOrderId || o.owner == kNoOwner) return std::nullopt;
+            auto *lvl = ensure_level(s, p);
+            if (!lvl) return std::nullopt;
+            Slot slot = pool_.acquire(o);
+            Handle h{p, slot, s};
+            if (!by_id_.insert(oid, h)) {
+                pool_.reserve(slot).qty = 0;
+                pool_.release(slot);
+                erase_level_if_empty(s, p);
+                return std::nullopt;
+            }
+            link(o, *lvl, slot);
 
 #ifndef NDEBUG
             assert_invariants();
@@ -36,269 +56,1006 @@ namespace me {
             return h;
         }
 
-        std::vector<Trade> add_limit(Order o) {
-            std::vector<Trade> out;
+        // Sink overloads emit every fill as sink(const Trade&) and never allocate;
+        // the vector-returning forms are thin wrappers over them. They return false
+        // if the order was rejected without trading (a FOK the book cannot fill, or
+        // an id that is already live).
+        // Fills from stops the order triggers go to the same sink.
+        template<class Sink>
+        bool add_limit(Order o, Sink &&sink) {
+            stp_cancelled_.clear();
+            if (phase_ == Phase::Call) return rests(o.tif) && admissible(o) && post_passive(std::move(o)).has_value();
+            if (o.post_only != PostOnly::Off) return add_post_only(std::move(o));
+            bool ok = submit_limit(o, sink);
+            release_stops(sink);
+            return ok;
+        }
+
+        // Checked against the cached opposite touch only; no matching attempt and no
+        // trade output. Returns false if rejected, if the price cannot rest, or on
+        // the checks of any limit order (a live id, an IOC/FOK tif that may not
+        // rest, an expiry already passed).
+        bool add_post_only(Order o) {
+            stp_cancelled_.clear();
+            if (!rests(o.tif) || !admissible(o)) return false;
             if (o.side == Side::Buy) {
-                match_buy(o, false, out);
+                if (const PriceLevel *ask = asks_.best(); ask && o.px >= ask->px) {
+                    if (o.post_only == PostOnly::Reject) return false;
+                    o.px = ask->px - tick_;
+                }
             } else {
-                match_sell(o, false, out);
+                if (const PriceLevel *bid = bids_.best(); bid && o.px <= bid->px) {
+                    if (o.post_only == PostOnly::Reject) return false;
+                    o.px = bid->px + tick_;
+                }
             }
-            if (o.qty > 0) post_passive(std::move(o));
-#ifndef NDEBUG
-            assert_invariants();
-#endif
+            return post_passive(std::move(o)).has_value();
+        }
+
+        std::vector<Trade> add_limit(Order o) {
+            std::vector<Trade> out;
+            add_limit(std::move(o), [&out](const Trade &t) { out.push_back(t); });
             return out;
         }
 
+        template<class Sink>
+        bool add_market(Order o, Sink &&sink) {
+            stp_cancelled_.clear();
+            if (phase_ == Phase::Call) return false;
+            bool ok = submit_market(o, sink);
+            release_stops(sink);
+            return ok;
+        }
+
         std::vector<Trade> add_market(Order o) {
-            o.type = OrdType::Market;
             std::vector<Trade> out;
-            if (o.side == Side::Buy) {
-                match_buy(o, true, out);
-            } else {
-                match_sell(o, true, out);
+            add_market(std::move(o), [&out](const Trade &t) { out.push_back(t); });
+            return out;
+        }
+
+        // Parks a Stop/StopLimit order until a trade prints through stop_px; if the
+        // last trade already has, it is released immediately. False if the type is
+        // not a stop or the id is already live.
+        template<class Sink>
+        bool add_stop(Order o, Sink &&sink) {
+            stp_cancelled_.clear();
+            if (o.type != OrdType::Stop && o.type != OrdType::StopLimit) return false;
+            if (is_live(o.id) || !stops_.add(o)) return false;
+            release_stops(sink);
+            return true;
+        }
+
+        std::vector<Trade> add_stop(Order o) {
+            std::vector<Trade> out;
+            add_stop(std::move(o), [&out](const Trade &t) { out.push_back(t); });
+            return out;
+        }
+
+        // Rests a pegged order; px is ignored. Pegs are passive only: they never
+        // take on arrival and do not trade against each other. False if the peg is
+        // malformed or the id is already live.
+        bool add_peg(const Order &o) {
+            if (is_live(o.id)) return false;
+            return pegs_.add(o);
+        }
+
+        // Where a resting peg would trade right now, or nullopt if its reference
+        // side of the lit book is empty.
+        std::optional<Price> peg_price(OrderId id) const {
+            const PegBook::Ref *r = pegs_.find(id);
+            if (!r) return std::nullopt;
+            if (r->side == Side::Buy) return peg_px<Side::Buy>(r->type, r->offset);
+            return peg_px<Side::Sell>(r->type, r->offset);
+        }
+
+        // Moves the book clock to now and cancels every Gtd/Day order whose expiry
+        // has passed, reporting each through expired(OrderId). Returns the count.
+        template<class IdSink>
+        size_t advance_clock(Ts now, IdSink &&expired) {
+            clock_ = std::max(clock_, now);
+            due_.clear();
+            wheel_.advance(now, due_);
+            size_t n = 0;
+            for (const TimingWheel::Entry &e: due_) {
+                // A later schedule for the same id (modify, id reuse) supersedes this one.
+                const Ts *at = expire_at_.find(e.id);
+                if (!at || *at != e.at) continue;
+                if (cancel(e.id)) {
+                    expired(e.id);
+                    ++n;
+                }
             }
+            return n;
+        }
+
+        std::vector<OrderId> advance_clock(Ts now) {
+            std::vector<OrderId> out;
+            advance_clock(now, [&out](OrderId id) { out.push_back(id); });
+            return out;
+        }
+
+        Phase phase() const { return phase_; }
+
+        // Enters the call phase: from here on limit orders rest without matching,
+        // even when they cross, until uncross().
+        void begin_call() { phase_ = Phase::Call; }
+
+        // The price uncross() would use now, with its volume and surplus; nullopt
+        // if nothing crosses. Pegs take no part in the auction.
+        std::optional<AuctionQuote> indicative_uncross() {
+            const PriceLevel *bid = bids_.best();
+            const PriceLevel *ask = asks_.best();
+            if (!bid || !ask || bid->px < ask->px) return std::nullopt;
+            Price lo = ask->px, hi = bid->px;
+
+            // Merge the crossed levels of both sides into one ascending price column.
+            auction_bids_.clear();
+            bids_.walk([&](const PriceLevel &l) {
+                if (l.px < lo) return false;
+                auction_bids_.push_back(&l);
+                return true;
+            });
+            solver_.clear();
+            auto b = auction_bids_.rbegin();
+            asks_.walk([&](const PriceLevel &l) {
+                if (l.px > hi) return false;
+                for (; b != auction_bids_.rend() && (*b)->px < l.px; ++b) solver_.push((*b)->px, (*b)->depth(), 0);
+                if (b != auction_bids_.rend() && (*b)->px == l.px) solver_.push(l.px, (*b++)->depth(), l.depth());
+                else solver_.push(l.px, 0, l.depth());
+                return true;
+            });
+            for (; b != auction_bids_.rend(); ++b) solver_.push((*b)->px, (*b)->depth(), 0);
+            return solver_.solve(last_trade_px());
+        }
+
+        // Ends the call phase: executes the equilibrium volume at one price, best
+        // levels first and FIFO within each, then resumes continuous matching.
+        // Trades report the buy order as taker_id and the sell order as maker_id.
+        template<class Sink>
+        std::optional<AuctionQuote> uncross(Sink &&sink) {
+            stp_cancelled_.clear();
+            std::optional<AuctionQuote> q = indicative_uncross();
+            phase_ = Phase::Continuous;
+            if (!q) return q;
+            for (Qty left = q->volume; left > 0;) {
+                PriceLevel &b = *bids_.best();
+                PriceLevel &a = *asks_.best();
+                Slot bs = b.head, as = a.head;
+                auto &buy = pool_.hot(bs);
+                auto &sell = pool_.hot(as);
+                OrderId buy_id = buy.id, sell_id = sell.id;
+                Qty fill = std::min<Qty>(std::min<Qty>(buy.qty, sell.qty), left);
+                sink(Trade{buy_id, sell_id, q->px, fill, clock_});
+                left -= fill;
+                buy.qty -= static_cast<typename Layout::Qty>(fill);
+                sell.qty -= static_cast<typename Layout::Qty>(fill);
+                b.total -= fill;
+                a.total -= fill;
+                bids_.add_depth(b, -fill);
+                asks_.add_depth(a, -fill);
+                if (buy.qty == 0) retire_head(b, bs, buy_id);
+                if (sell.qty == 0) retire_head(a, as, sell_id);
+                if (b.empty()) bids_.pop_best();
+                if (a.empty()) asks_.pop_best();
+            }
+            last_px_ = q->px;
+            traded_ = true;
 #ifndef NDEBUG
             assert_invariants();
 #endif
+            release_stops(sink);
+            return q;
+        }
+
+        std::vector<Trade> uncross() {
+            std::vector<Trade> out;
+            uncross([&out](const Trade &t) { out.push_back(t); });
             return out;
         }
 
-        std::vector<Trade> modify(OrderId id, std::optional<Price> new_px, std::optional<Qty> new_qty, Ts ts_now) {
-            std::vector<Trade> trades;
+        // Resting orders that self-trade prevention removed without a trade during
+        // the last order entry call: add_limit, add_post_only, add_market, add_stop,
+        // modify or uncross. Each of them clears the list first.
+        const std::vector<OrderId> &stp_cancelled() const { return stp_cancelled_; }
 
-            auto it_idx = by_id_.find(id);
-            if (it_idx == by_id_.end()) return trades;
+        std::optional<Price> last_trade_px() const {
+            if (!traded_) return std::nullopt;
+            return last_px_;
+        }
 
-            Handle h = it_idx->second;
+        // Returns false if the id is not resting, or if the new price or qty could
+        // not rest (off the tick grid, outside a dense band, too large for the
+        // layout); the order is then left untouched. An iceberg's qty is its visible
+        // slice plus reserve; a reduction comes out of the reserve first. A qty
+        // increase, or a reprice that cannot trade, keeps the slot and by_id_ entry
+        // and relinks the order at the back of its target level; anything else
+        // takes the order off the book and re-matches it, keeping the by_id_ entry
+        // and re-pointing it at the new slot if a remainder rests.
+        template<class Sink>
+        bool modify(OrderId id, std::optional<Price> new_px, std::optional<Qty> new_qty, Ts ts_now, Sink &&sink) {
+            stp_cancelled_.clear();
+            Handle *hp = by_id_.find(id);
+            if (!hp) return false;
+
+            Handle h = *hp;
             PriceLevel *lvl = find_level(h.side, h.px);
             if (!lvl) {
-                by_id_.erase(it_idx);
-                return trades;
+                by_id_.erase(id);
+                return false;
             }
 
-            Order &ref = *(h.it);
-            Price target_px = new_px.value_or(ref.px);
-            Price target_qty = new_qty.value_or(ref.qty);
+            const Ts *exp = expire_at_.empty() ? nullptr : expire_at_.find(id);
+            bool has_expiry = exp != nullptr;
+            Ts expire_ts = exp ? *exp : 0;
+            auto &ref = pool_.hot(h.slot);
+            Qty hidden = lvl->hidden > 0 ? static_cast<Qty>(pool_.reserve(h.slot).qty) : 0;
+            Qty live_qty = ref.qty + hidden;
+            Price target_px = new_px.value_or(h.px);
+            Qty target_qty = new_qty.value_or(live_qty);
 
             if (target_qty <= 0) {
-                lvl->erase(h.it);
+                remove_order(h.side, *lvl, h.slot);
                 erase_level_if_empty(h.side, h.px);
-                by_id_.erase(it_idx);
+                by_id_.erase(id);
 #ifndef NDEBUG
                 assert_invariants();
 #endif
-                return trades;
+                return true;
             }
 
-            bool price_changed = (target_px != ref.px);
-            bool qty_up = (target_qty > ref.qty);
+            // A price or qty that cannot rest leaves the order as it is.
+            Order probe{id, h.side, OrdType::Limit, target_px, target_qty, ts_now};
+            if (!bids_.accepts(target_px) || !pool_.fits(probe)) return false;
+
+            bool price_changed = (target_px != h.px);
+            bool qty_up = (target_qty > live_qty);
+
+            if (!price_changed && !qty_up && target_qty < live_qty) {
+                Qty delta = live_qty - target_qty;
+                Qty from_reserve = std::min(delta, hidden);
+                if (from_reserve > 0) {
+                    pool_.reserve(h.slot).qty -= static_cast<typename Layout::Qty>(from_reserve);
+                    lvl->hidden -= from_reserve;
+                }
+                ref.qty -= static_cast<typename Layout::Qty>(delta - from_reserve);
+                lvl->total -= delta - from_reserve;
+                add_depth(h.side, *lvl, -delta);
+#ifndef NDEBUG
+                assert_invariants();
+#endif
+                return true;
+            }
 
-            if (!price_changed && !qty_up && target_qty < ref.qty) {
-                Qty delta = ref.qty - target_qty;
-                ref.qty = target_qty;
-                lvl->total -= delta;
+            if (hidden == 0 && !(price_changed && may_cross(h.side, target_px))) {
+                PriceLevel *dst = ensure_level(h.side, target_px);
+                if (dst == lvl && target_qty == live_qty) return true;
+                lvl->erase(pool_, h.slot);
+                add_depth(h.side, *lvl, -live_qty);
+                ref.qty = static_cast<typename Layout::Qty>(target_qty);
+                pool_.cold(h.slot).ts = ts_now;
+                pool_.set_px(h.slot, target_px);
+                dst->push(pool_, h.slot);
+                add_depth(h.side, *dst, target_qty);
+                if (dst != lvl) erase_level_if_empty(h.side, h.px);
+                hp->px = target_px;
 #ifndef NDEBUG
                 assert_invariants();
 #endif
-                return trades;
+                return true;
             }
 
-            Side side = ref.side;
-            OrdType type = OrdType::Limit;
+            Order fresh(id, h.side, OrdType::Limit, target_px, target_qty, ts_now);
+            fresh.display = hidden > 0 ? static_cast<Qty>(pool_.reserve(h.slot).peak) : 0;
+            fresh.owner = ref.owner;
+            if (has_expiry) {
+                fresh.tif = TimeInForce::Gtd;
+                fresh.expire_ts = expire_ts;
+            }
 
-            lvl->erase(h.it);
+            remove_order(h.side, *lvl, h.slot);
             erase_level_if_empty(h.side, h.px);
-            by_id_.erase(it_idx);
 
-            Order fresh(id, side, type, target_px, target_qty, ts_now);
-            auto deals = add_limit(fresh);
-            trades.insert(trades.end(), deals.begin(), deals.end());
+            if (phase_ == Phase::Continuous) {
+                if (fresh.side == Side::Buy) {
+                    match<Side::Buy>(fresh, false, sink);
+                } else {
+                    match<Side::Sell>(fresh, false, sink);
+                }
+            }
+            // Matching may have moved entries of a flat index.
+            hp = by_id_.find(id);
+            if (fresh.qty > 0) {
+                PriceLevel *dst = ensure_level(fresh.side, fresh.px);
+                Slot slot = pool_.acquire(fresh);
+                link(fresh, *dst, slot);
+                *hp = Handle{fresh.px, slot, fresh.side};
+            } else {
+                by_id_.erase(id);
+            }
 #ifndef NDEBUG
             assert_invariants();
 #endif
+            release_stops(sink);
+            return true;
+        }
+
+        std::vector<Trade> modify(OrderId id, std::optional<Price> new_px, std::optional<Qty> new_qty, Ts ts_now) {
+            std::vector<Trade> trades;
+            modify(id, new_px, new_qty, ts_now, [&trades](const Trade &t) { trades.push_back(t); });
             return trades;
         }
 
         std::optional<std::pair<Price, Qty> > best_bid() const {
-            if (bids_.empty()) return std::nullopt;
-            auto it = bids_.begin();
-            return std::make_pair(it->first, it->second.total);
+            const PriceLevel *lvl = bids_.best();
+            if (!lvl) return std::nullopt;
+            return std::make_pair(lvl->px, lvl->total);
         }
 
         std::optional<std::pair<Price, Qty> > best_ask() const {
-            if (asks_.empty()) return std::nullopt;
-            auto it = asks_.begin();
-            return std::make_pair(it->first, it->second.total);
+            const PriceLevel *lvl = asks_.best();
+            if (!lvl) return std::nullopt;
+            return std::make_pair(lvl->px, lvl->total);
+        }
+
+        struct SweepPlan {
+            Qty fillable{0};
+            std::optional<Price> last_px;
+        };
+
+        // What a taker of qty on side s (limited at limit, if any) would get from the
+        // book right now, without touching it: the executable qty and the worst
+        // price it reaches. O(log L) on the dense ladder.
+        SweepPlan plan_sweep(Side s, Qty qty, std::optional<Price> limit = std::nullopt) const {
+            if (s == Side::Buy) return plan_side_sweep(asks_, qty, limit.value_or(std::numeric_limits<Price>::max()));
+            return plan_side_sweep(bids_, qty, limit.value_or(std::numeric_limits<Price>::min()));
+        }
+
+        // Whether qty on side s could execute in full at limit or better. Decided
+        // from level totals only: O(log L) on the dense ladder, and on the map
+        // ladder it stops at the first level where enough qty has accumulated.
+        bool can_fill(Side s, Qty qty, std::optional<Price> limit) const {
+            if (s == Side::Buy) return asks_.depth_through(limit.value_or(std::numeric_limits<Price>::max()), qty) >= qty;
+            return bids_.depth_through(limit.value_or(std::numeric_limits<Price>::min()), qty) >= qty;
+        }
+
+        LadderStats level_stats() const {
+            const LadderStats &b = bids_.stats();
+            const LadderStats &a = asks_.stats();
+            return LadderStats{b.levels_created + a.levels_created, b.levels_reused + a.levels_reused};
         }
 
         bool cancel(OrderId id) {
-            auto it = by_id_.find(id);
-            if (it == by_id_.end()) return false;
-            Handle h = it->second;
+            const Handle *hp = by_id_.find(id);
+            if (!hp) return stops_.cancel(id) || pegs_.cancel(id);
+            Handle h = *hp;
 
-            auto &book = (h.side == Side::Buy) ? reinterpret_cast<MapRef &>(bids_) : reinterpret_cast<MapRef &>(asks_);
             auto *lvl = find_level(h.side, h.px);
             if (!lvl) {
-                by_id_.erase(it);
+                by_id_.erase(id);
                 return false;
             }
 
-            lvl->erase(h.it);
+            remove_order(h.side, *lvl, h.slot);
             erase_level_if_empty(h.side, h.px);
-            by_id_.erase(it);
+            by_id_.erase(id);
 #ifndef NDEBUG
             assert_invariants();
 #endif
             return true;
         }
 
-    private:
-        using MapRef = std::map<Price, PriceLevel>;
+        // Mass cancels. Each walks the affected levels once, reports every removed id
+        // through cancelled(OrderId) and returns the count. Whole levels go back to
+        // the pool as one chain; no per-order lookup or level search is made.
+        // cancel_side and cancel_all include stops and pegs.
+        template<class IdSink>
+        size_t cancel_all(IdSink &&cancelled) {
+            return cancel_side(Side::Buy, cancelled) + cancel_side(Side::Sell, cancelled);
+        }
+
+        template<class IdSink>
+        size_t cancel_side(Side s, IdSink &&cancelled) {
+            size_t n = cancel_range(s, std::numeric_limits<Price>::min(), std::numeric_limits<Price>::max(), cancelled);
+            n += stops_.cancel_if([s](const Order &o) { return o.side == s; }, cancelled);
+            n += pegs_.cancel_if(s, [](OwnerId) { return true; }, cancelled);
+            return n;
+        }
 
+        // Resting limit orders priced in [lo, hi] on side s; an empty range if lo > hi.
+        template<class IdSink>
+        size_t cancel_range(Side s, Price lo, Price hi, IdSink &&cancelled) {
+            if (lo > hi) return 0;
+            size_t n = 0;
+            auto drop = [&](PriceLevel &lvl) { n += drop_level(lvl, cancelled); };
+            if (s == Side::Buy) bids_.prune(lo, hi, drop);
+            else asks_.prune(lo, hi, drop);
+#ifndef NDEBUG
+            assert_invariants();
+#endif
+            return n;
+        }
+
+        // Every order, stops and pegs included, entered by one owner.
+        template<class IdSink>
+        size_t cancel_owner(OwnerId owner, IdSink &&cancelled) {
+            size_t n = 0;
+            auto pick = [&](PriceLevel &lvl) {
+                for (Slot s = lvl.head; s != kNilSlot;) {
+                    Slot next = pool_.hot(s).next;
+                    if (pool_.owner(s) == owner) {
+                        OrderId id = pool_.hot(s).id;
+                        unlink_order(lvl, s);
+                        by_id_.erase(id);
+                        cancelled(id);
+                        ++n;
+                    }
+                    s = next;
+                }
+            };
+            bids_.prune(std::numeric_limits<Price>::min(), std::numeric_limits<Price>::max(), pick);
+            asks_.prune(std::numeric_limits<Price>::min(), std::numeric_limits<Price>::max(), pick);
+            n += stops_.cancel_if([owner](const Order &o) { return o.owner == owner; }, cancelled);
+            for (Side s: {Side::Buy, Side::Sell}) n += pegs_.cancel_if(s, [owner](OwnerId o) { return o == owner; }, cancelled);
+#ifndef NDEBUG
+            assert_invariants();
+#endif
+            return n;
+        }
+
+    private:
         Bids bids_;
         Asks asks_;
-        std::unordered_map<OrderId, Handle> by_id_;
+        OrderPool<Layout> pool_;
+        Index<Handle> by_id_;
+        Price tick_;
+        StopBook stops_;
+        PegBook pegs_;
+        std::vector<OrderId> stp_cancelled_;
+        [[no_unique_address]] Alloc alloc_;
+        Phase phase_{Phase::Continuous};
+        AuctionSolver solver_;
+        std::vector<const PriceLevel *> auction_bids_;
+        Ts session_close_;
+        Ts clock_{0};
+        TimingWheel wheel_;
+        // Expiry of every resting Gtd/Day order; wheel entries that disagree are stale.
+        FlatIdMap<Ts> expire_at_;
+        std::vector<TimingWheel::Entry> due_;
+
+        static bool expires(TimeInForce tif) { return tif == TimeInForce::Gtd || tif == TimeInForce::Day; }
+        static bool rests(TimeInForce tif) { return tif != TimeInForce::Ioc && tif != TimeInForce::Fok; }
+
+        Ts expiry_of(const Order &o) const { return o.tif == TimeInForce::Day ? session_close_ : o.expire_ts; }
 
-        PriceLevel &ensure_level(Side s, Price px) {
+        void schedule_expiry(OrderId id, Ts at) {
+            if (Ts *e = expire_at_.find(id)) *e = at;
+            else expire_at_.insert(id, at);
+            wheel_.schedule(id, at);
+        }
+
+        void forget_expiry(OrderId id) {
+            if (!expire_at_.empty()) expire_at_.erase(id);
+        }
+        std::vector<Order> fired_;
+        Price last_px_{0};
+        bool traded_{false};
+
+        // Resting, parked as a stop or pegged.
+        bool is_live(OrderId id) const {
+            return by_id_.find(id) || stops_.contains(id) || pegs_.find(id);
+        }
+
+        // Checks every limit order passes before it may trade or rest: a live id
+        // could not rest its remainder, and an expiry already passed never rests.
+        bool admissible(const Order &o) const {
+            return !is_live(o.id) && !(expires(o.tif) && expiry_of(o) <= clock_);
+        }
+
+        template<class Sink>
+        bool submit_limit(Order &o, Sink &sink) {
+            if (!admissible(o)) return false;
+            if (o.tif == TimeInForce::Fok && !fok_fillable(o, false)) return false;
+            if (o.side == Side::Buy) {
+                match<Side::Buy>(o, false, sink);
+            } else {
+                match<Side::Sell>(o, false, sink);
+            }
+            if (o.qty > 0 && rests(o.tif)) post_passive(std::move(o));
+#ifndef NDEBUG
+            assert_invariants();
+#endif
+            return true;
+        }
+
+        template<class Sink>
+        bool submit_market(Order &o, Sink &sink) {
+            o.type = OrdType::Market;
+            if (o.tif == TimeInForce::Fok && !fok_fillable(o, true)) return false;
+            if (o.side == Side::Buy) {
+                match<Side::Buy>(o, true, sink);
+            } else {
+                match<Side::Sell>(o, true, sink);
+            }
+#ifndef NDEBUG
+            assert_invariants();
+#endif
+            return true;
+        }
+
+        // FOK is decided from lit depth. With STP, depth of the taker's own owner
+        // cannot fill it: CancelOldest removes those orders on the way, so only the
+        // rest counts; the other modes stop or shrink the taker at the first one,
+        // so only what queues ahead of it counts and an own peg rejects the order.
+        bool fok_fillable(const Order &o, bool is_market) const {
+            if (!can_fill(o.side, o.qty, is_market ? std::nullopt : std::optional<Price>(o.px))) return false;
+            if (o.stp == Stp::Off) return true;
+            if (o.side == Side::Buy) return fillable_past_owner<Side::Sell>(o, is_market);
+            return fillable_past_owner<Side::Buy>(o, is_market);
+        }
+
+        // O(orders inside the limit on side P); only FOK takers with STP pay it.
+        template<Side P>
+        bool fillable_past_owner(const Order &o, bool is_market) const {
+            if (o.stp != Stp::CancelOldest && pegs_.has_owner(P, o.owner)) return false;
+            Qty avail = 0;
+            bool ok = false;
+            side_levels<P>().walk([&](const PriceLevel &lvl) {
+                if (!is_market && !crosses<opposite(P)>(o.px, lvl.px)) return false;
+                Qty own = 0;
+                Qty ahead = 0;
+                bool met = false;
+                for (Slot s = lvl.head; s != kNilSlot; s = pool_.hot(s).next) {
+                    if (pool_.owner(s) == o.owner) {
+                        met = true;
+                        own += pool_.hot(s).qty + (lvl.hidden > 0 ? static_cast<Qty>(pool_.reserve(s).qty) : 0);
+                    } else if (!met) {
+                        ahead += pool_.hot(s).qty;
+                    }
+                }
+                if (met && o.stp != Stp::CancelOldest) {
+                    ok = avail + ahead >= o.qty;
+                    return false;
+                }
+                avail += lvl.depth() - own;
+                ok = avail >= o.qty;
+                return !ok;
+            });
+            return ok;
+        }
+
+        // Fires stops in batches: everything the current last price triggers goes
+        // in arrival order, then the new last price is checked again.
+        template<class Sink>
+        void release_stops(Sink &sink) {
+            if (phase_ == Phase::Call) return;
+            while (traded_ && stops_.armed(last_px_)) {
+                stops_.take_triggered(last_px_, fired_);
+                for (Order &o: fired_) {
+                    if (o.type == OrdType::Stop) {
+                        submit_market(o, sink);
+                    } else {
+                        o.type = OrdType::Limit;
+                        submit_limit(o, sink);
+                    }
+                }
+                fired_.clear();
+            }
+        }
+
+        // Queues an acquired slot at the back of lvl and accounts for it.
+        void link(const Order &o, PriceLevel &lvl, Slot s) {
+            lvl.push(pool_, s);
+            if (o.display > 0) lvl.hidden += pool_.reserve(s).qty;
+            add_depth(o.side, lvl, o.qty);
+            if (expires(o.tif)) schedule_expiry(o.id, expiry_of(o));
+        }
+
+        void remove_order(Side side, PriceLevel &lvl, Slot s) {
+            add_depth(side, lvl, -unlink_order(lvl, s));
+        }
+
+        // Takes s off its level and frees the slot; returns the qty removed, reserve
+        // included. Depth and by_id_ are left to the caller.
+        Qty unlink_order(PriceLevel &lvl, Slot s) {
+            forget_expiry(pool_.hot(s).id);
+            Qty gone = pool_.hot(s).qty;
+            if (lvl.hidden > 0) {
+                auto &r = pool_.reserve(s);
+                gone += r.qty;
+                lvl.hidden -= r.qty;
+                r.qty = 0;
+            }
+            lvl.erase(pool_, s);
+            pool_.release(s);
+            return gone;
+        }
+
+        // Empties lvl in one pass and returns its queue to the pool as one chain.
+        template<class IdSink>
+        size_t drop_level(PriceLevel &lvl, IdSink &cancelled) {
+            size_t n = lvl.count;
+            for (Slot s = lvl.head; s != kNilSlot; s = pool_.hot(s).next) {
+                OrderId id = pool_.hot(s).id;
+                if (lvl.hidden > 0) pool_.reserve(s).qty = 0;
+                by_id_.erase(id);
+                forget_expiry(id);
+                cancelled(id);
+            }
+            pool_.release_chain(lvl.head, lvl.tail, n);
+            lvl.detach_all();
+            return n;
+        }
+
+        // Moves the next slice of an iceberg's reserve to the back of its level.
+        // The slot, and with it the by_id_ handle, stays as it is.
+        void replenish(PriceLevel &lvl, Slot s) {
+            auto &r = pool_.reserve(s);
+            auto slice = std::min(r.qty, r.peak);
+            r.qty -= slice;
+            lvl.hidden -= slice;
+            pool_.hot(s).qty = slice;
+            lvl.push(pool_, s);
+        }
+
+        void add_depth(Side s, const PriceLevel &lvl, Qty delta) {
             if (s == Side::Buy) {
-                auto [it, _] = bids_.try_emplace(px);
-                it->second.px = px;
-                return it->second;
+                bids_.add_depth(lvl, delta);
             } else {
-                auto [it, _] = asks_.try_emplace(px);
-                it->second.px = px;
-                return it->second;
+                asks_.add_depth(lvl, delta);
+            }
+        }
+
+        PriceLevel *ensure_level(Side s, Price px) {
+            if (s == Side::Buy) {
+                return bids_.ensure(px);
+            } else {
+                return asks_.ensure(px);
             }
         }
 
         PriceLevel *find_level(Side s, Price px) {
             if (s == Side::Buy) {
-                auto it = bids_.find(px);
-                return it == bids_.end() ? nullptr : &it->second;
+                return bids_.find(px);
             } else {
-                auto it = asks_.find(px);
-                return it == asks_.end() ? nullptr : &it->second;
+                return asks_.find(px);
             }
         }
 
         void erase_level_if_empty(Side s, Price px) {
             if (s == Side::Buy) {
-                auto it = bids_.find(px);
-                if (it != bids_.end() && it->second.empty()) bids_.erase(it);
+                bids_.erase_if_empty(px);
             } else {
-                auto it = asks_.find(px);
-                if (it != asks_.end() && it->second.empty()) asks_.erase(it);
+                asks_.erase_if_empty(px);
             }
         }
 
-        void match_buy(Order &taker, bool is_market, std::vector<Trade> &out) {
-            while (taker.qty > 0 && !asks_.empty()) {
-                auto it_level = asks_.begin();
-                Price level_px = it_level->first;
+        template<class SideLevels>
+        static SweepPlan plan_side_sweep(const SideLevels &side, Qty qty, Price limit) {
+            SweepPlan plan;
+            plan.fillable = std::min(qty, side.depth_through(limit));
+            if (plan.fillable > 0) plan.last_px = side.price_for_qty(plan.fillable);
+            return plan;
+        }
 
-                if (!is_market && level_px > taker.px) break;
+        template<Side S>
+        auto &side_levels() {
+            if constexpr (S == Side::Buy) return bids_;
+            else return asks_;
+        }
 
-                PriceLevel &lvl = it_level->second;
+        template<Side S>
+        const auto &side_levels() const {
+            if constexpr (S == Side::Buy) return bids_;
+            else return asks_;
+        }
 
-                while (taker.qty > 0 && !lvl.dq.empty()) {
-                    Order &maker = lvl.dq.front();
-                    OrderId maker_id = maker.id;
-                    Qty fill = (taker.qty < maker.qty) ? taker.qty : maker.qty;
+        template<Side S>
+        static bool improves(Price a, Price b) {
+            if constexpr (S == Side::Buy) return a > b;
+            else return a < b;
+        }
+
+        // Effective price of a peg group on side P against the current lit BBO.
+        // It is clamped a tick behind the lit opposite touch so it never crosses.
+        template<Side P>
+        std::optional<Price> peg_px(PegType t, Price offset) const {
+            const PriceLevel *bid = bids_.best();
+            const PriceLevel *ask = asks_.best();
+            Price px;
+            if (t == PegType::Primary) {
+                const PriceLevel *ref = (P == Side::Buy) ? bid : ask;
+                if (!ref) return std::nullopt;
+                px = (P == Side::Buy) ? ref->px - offset : ref->px + offset;
+            } else {
+                if (!bid || !ask) return std::nullopt;
+                Price half = (ask->px - bid->px) / 2 / tick_ * tick_;
+                px = (P == Side::Buy) ? bid->px + half - offset : ask->px - half + offset;
+            }
+            if constexpr (P == Side::Buy) {
+                if (ask && px >= ask->px) px = ask->px - tick_;
+            } else {
+                if (bid && px <= bid->px) px = bid->px + tick_;
+            }
+            return px;
+        }
 
-                    out.push_back(Trade{
-                        taker.id,
-                        maker_id,
-                        level_px,
-                        fill,
-                        taker.ts
-                    });
+        struct PegQuote {
+            Price px;
+            PegType type;
+        };
 
-                    taker.qty -= fill;
-                    maker.qty -= fill;
-                    lvl.total -= fill;
+        // Best active peg group on side P: one price per peg type from the front
+        // group, so the cost does not depend on how many pegs rest.
+        template<Side P>
+        std::optional<PegQuote> best_peg() const {
+            std::optional<PegQuote> best;
+            for (PegType t: {PegType::Primary, PegType::Mid}) {
+                const PriceLevel *g = pegs_.front(P, t);
+                if (!g) continue;
+                std::optional<Price> px = peg_px<P>(t, g->px);
+                if (px && (!best || improves<P>(*px, best->px))) best = PegQuote{*px, t};
+            }
+            return best;
+        }
 
-                    if (maker.qty == 0) {
-                        lvl.dq.pop_front();
-                        by_id_.erase(maker_id);
-                    }
-                }
+        // True if a taker on side S limited at limit_px may trade at level_px.
+        template<Side S>
+        static bool crosses(Price limit_px, Price level_px) {
+            if constexpr (S == Side::Buy) return level_px <= limit_px;
+            else return level_px >= limit_px;
+        }
 
-                if (lvl.empty()) {
-                    asks_.erase(it_level);
-                } else {
-                    if (!is_market && it_level->first > taker.px) break;
-                }
+        // True if a limit at px on side s could trade on arrival. Any peg on the
+        // other side counts as a possible cross.
+        bool may_cross(Side s, Price px) const {
+            if (!pegs_.empty(opposite(s))) return true;
+            if (s == Side::Buy) {
+                const PriceLevel *ask = asks_.best();
+                return ask && px >= ask->px;
             }
+            const PriceLevel *bid = bids_.best();
+            return bid && px <= bid->px;
         }
 
-        void match_sell(Order &taker, bool is_market, std::vector<Trade> &out) {
-            while (taker.qty > 0 && !bids_.empty()) {
-                auto it_level = bids_.begin();
-                Price level_px = it_level->first;
+        template<Side S, class Sink>
+        void match(Order &taker, bool is_market, Sink &sink) {
+            constexpr Side P = opposite(S);
+            OwnerId stp_owner = taker.stp == Stp::Off ? kNoOwner : taker.owner;
+            auto &book = side_levels<P>();
+            while (taker.qty > 0) {
+                PriceLevel *best = book.best();
+                // Pegs are priced from the lit touch as it stands now and go ahead
+                // of the lit level only when strictly better; at an equal price
+                // they trade after its queue.
+                if (!pegs_.empty(P)) {
+                    std::optional<PegQuote> peg = best_peg<P>();
+                    if (peg && (!best || improves<P>(peg->px, best->px))) {
+                        if (!is_market && !crosses<S>(taker.px, peg->px)) break;
+                        auto stp_cancel = [this](OrderId id) { stp_cancelled_.push_back(id); };
+                        if (pegs_.fill(P, peg->type, taker, peg->px, stp_owner, sink, stp_cancel)) {
+                            last_px_ = peg->px;
+                            traded_ = true;
+                        }
+                        continue;
+                    }
+                }
+                if (!best) break;
+                PriceLevel &lvl = *best;
+                if (!is_market && !crosses<S>(taker.px, lvl.px)) break;
 
-                if (!is_market && level_px < taker.px) break;
+                Qty before = lvl.depth();
+                if (consume_level(taker, lvl, stp_owner, sink)) {
+                    last_px_ = lvl.px;
+                    traded_ = true;
+                }
+                book.add_depth(lvl, lvl.depth() - before);
+                if (!lvl.empty()) continue;
 
-                PriceLevel &lvl = it_level->second;
+                // The emptied level is still the touch until popped, so pegs
+                // joining it are priced there.
+                while (taker.qty > 0 && !pegs_.empty(P)) {
+                    std::optional<PegQuote> peg = best_peg<P>();
+                    if (!peg || peg->px != lvl.px) break;
+                    auto stp_cancel = [this](OrderId id) { stp_cancelled_.push_back(id); };
+                    if (pegs_.fill(P, peg->type, taker, peg->px, stp_owner, sink, stp_cancel)) {
+                        last_px_ = peg->px;
+                        traded_ = true;
+                    }
+                }
+                book.pop_best();
+            }
+        }
 
-                while (taker.qty > 0 && !lvl.dq.empty()) {
-                    Order &maker = lvl.dq.front();
-                    OrderId maker_id = maker.id;
-                    Qty fill = (taker.qty < maker.qty) ? taker.qty : maker.qty;
+        // Returns whether anything traded. A maker owned by stp_owner costs the loop
+        // one compare and is resolved by prevent_self_trade instead of filling.
+        template<class Sink>
+        bool consume_level(Order &taker, PriceLevel &lvl, OwnerId stp_owner, Sink &sink) {
+            if (taker.qty >= lvl.total && lvl.hidden == 0 && stp_owner == kNoOwner) {
+                consume_whole_level(taker, lvl, sink);
+                return true;
+            }
+            if constexpr (!std::is_same_v<Alloc, FifoAllocation>) {
+                // STP is resolved in queue order, so such takers keep the FIFO walk.
+                if (stp_owner == kNoOwner) return consume_allocated(taker, lvl, sink);
+            }
+            Price level_px = lvl.px;
+            bool traded = false;
+            while (taker.qty > 0 && !lvl.empty()) {
+                Slot slot = lvl.head;
+                auto &maker = pool_.hot(slot);
+                if (maker.owner == stp_owner) [[unlikely]] {
+                    prevent_self_trade(taker, lvl, slot);
+                    continue;
+                }
+                OrderId maker_id = maker.id;
+                Qty fill = (taker.qty < maker.qty) ? taker.qty : maker.qty;
 
-                    out.push_back(Trade{
-                        taker.id,
-                        maker_id,
-                        level_px,
-                        fill,
-                        taker.ts
-                    });
+                sink(Trade{
+                    taker.id,
+                    maker_id,
+                    level_px,
+                    fill,
+                    taker.ts
+                });
+                traded = true;
 
-                    taker.qty -= fill;
-                    maker.qty -= fill;
-                    lvl.total -= fill;
+                taker.qty -= fill;
+                maker.qty -= static_cast<typename Layout::Qty>(fill);
+                lvl.total -= fill;
 
-                    if (maker.qty == 0) {
-                        lvl.dq.pop_front();
-                        by_id_.erase(maker_id);
-                    }
-                }
+                if (maker.qty == 0) retire_head(lvl, slot, maker_id);
+            }
+            return traded;
+        }
 
-                if (lvl.empty()) {
-                    bids_.erase(it_level);
+        // Splits the taker over the whole level as the allocation policy decides.
+        template<class Sink>
+        bool consume_allocated(Order &taker, PriceLevel &lvl, Sink &sink) {
+            alloc_.clear();
+            for (Slot s = lvl.head; s != kNilSlot; s = pool_.hot(s).next) {
+                alloc_.slots.push_back(s);
+                alloc_.qty.push_back(pool_.hot(s).qty);
+            }
+            alloc_.allocate(std::min(taker.qty, lvl.total), lvl.total);
+            for (size_t i = 0; i < alloc_.slots.size(); ++i) {
+                Qty fill = alloc_.fill[i];
+                if (fill == 0) continue;
+                Slot slot = alloc_.slots[i];
+                auto &maker = pool_.hot(slot);
+                OrderId maker_id = maker.id;
+                sink(Trade{taker.id, maker_id, lvl.px, fill, taker.ts});
+                taker.qty -= fill;
+                maker.qty -= static_cast<typename Layout::Qty>(fill);
+                lvl.total -= fill;
+                if (maker.qty != 0) continue;
+                lvl.erase(pool_, slot);
+                if (lvl.hidden > 0 && pool_.reserve(slot).qty > 0) {
+                    replenish(lvl, slot);
                 } else {
-                    if (!is_market && it_level->first < taker.px) break;
+                    pool_.release(slot);
+                    by_id_.erase(maker_id);
+                    forget_expiry(maker_id);
                 }
             }
+            return true;
         }
 
-#ifndef NDEBUG
-            static Qty sum_level(const PriceLevel& lvl) {
-                Qty s = 0;
-                for (const auto& o : lvl.dq) s+=o.qty;
-                return s;
+        // The head of lvl has no visible qty left: replenish it from its reserve,
+        // or free it. Returns true if the order is gone.
+        bool retire_head(PriceLevel &lvl, Slot slot, OrderId id) {
+            lvl.pop_front(pool_);
+            if (lvl.hidden > 0 && pool_.reserve(slot).qty > 0) {
+                replenish(lvl, slot);
+                return false;
             }
+            pool_.release(slot);
+            by_id_.erase(id);
+            forget_expiry(id);
+            return true;
+        }
 
-            void assert_side_invariants(const Bids& side) const {
-                for (const auto& [px,lvl] : side) {
-                    assert(lvl.px == px);
-                    assert(!lvl.dq.empty());
-                    assert(sum_level(lvl) == lvl.total);
+        // The taker met its own resting order at the head of lvl.
+        void prevent_self_trade(Order &taker, PriceLevel &lvl, Slot slot) {
+            auto &maker = pool_.hot(slot);
+            OrderId maker_id = maker.id;
+            switch (taker.stp) {
+                case Stp::CancelNewest:
+                    taker.qty = 0;
+                    break;
+                case Stp::CancelBoth:
+                    taker.qty = 0;
+                    [[fallthrough]];
+                case Stp::CancelOldest:
+                    unlink_order(lvl, slot);
+                    by_id_.erase(maker_id);
+                    stp_cancelled_.push_back(maker_id);
+                    break;
+                case Stp::Decrement: {
+                    Qty d = std::min<Qty>(taker.qty, maker.qty);
+                    taker.qty -= d;
+                    maker.qty -= static_cast<typename Layout::Qty>(d);
+                    lvl.total -= d;
+                    if (maker.qty == 0 && retire_head(lvl, slot, maker_id)) stp_cancelled_.push_back(maker_id);
+                    break;
                 }
+                case Stp::Off:
+                    break;
+            }
+        }
+
+        // The taker outsizes the level and no reserve sits behind it: every maker
+        // fills completely, so emit the fills in one pass over the hot array and
+        // hand the queue back to the pool as a single chain.
+        template<class Sink>
+        void consume_whole_level(Order &taker, PriceLevel &lvl, Sink &sink) {
+            Price level_px = lvl.px;
+            for (Slot slot = lvl.head; slot != kNilSlot;) {
+                const auto &maker = pool_.hot(slot);
+                sink(Trade{
+                    taker.id,
+                    maker.id,
+                    level_px,
+                    maker.qty,
+                    taker.ts
+                });
+                by_id_.erase(maker.id);
+                forget_expiry(maker.id);
+                slot = maker.next;
             }
+            taker.qty -= lvl.total;
+            pool_.release_chain(lvl.head, lvl.tail, lvl.count);
+            lvl.detach_all();
+        }
 
-            void assert_side_invariants(const Asks& side) const {
-                for (const auto& [px,lvl] : side) {
-                    assert(lvl.px == px);
-                    assert(!lvl.dq.empty());
-                    assert(sum_level(lvl) == lvl.total);
+#ifndef NDEBUG
+            void assert_level_invariants(const PriceLevel& lvl) const {
+                assert(!lvl.empty());
+                Qty sum = 0, hidden = 0;
+                uint32_t count = 0;
+                Slot prev = kNilSlot;
+                for (Slot s = lvl.head; s != kNilSlot; s = pool_.hot(s).next) {
+                    const auto& n = pool_.hot(s);
+                    assert(s == lvl.head || pool_.cold(s).prev == prev);
+                    assert(pool_.px_of(s) == lvl.px);
+                    assert(n.qty > 0);
+                    sum += n.qty;
+                    hidden += pool_.reserve(s).qty;
+                    ++count;
+                    prev = s;
                 }
+                assert(prev == lvl.tail);
+                assert(sum == lvl.total);
+                assert(hidden == lvl.hidden);
+                assert(count == lvl.count);
+            }
+
+            template<class SideLevels>
+            size_t assert_side_invariants(const SideLevels& side) const {
+                size_t n = 0, orders = 0;
+                side.for_each([&](const PriceLevel& lvl) {
+                    assert_level_invariants(lvl);
+                    orders += lvl.size();
+                    ++n;
+                });
+                assert(n == side.size());
+                assert((side.best() == nullptr) == (n == 0));
+                Qty depth = 0;
+                side.for_each([&](const PriceLevel& lvl) { depth += lvl.depth(); });
+                // One extreme covers the whole side, the other none of it.
+                assert(side.depth_through(std::numeric_limits<Price>::max()) + side.depth_through(std::numeric_limits<Price>::min()) == depth);
+                return orders;
             }
 
             void assert_invariants() const {
-                assert_side_invariants(bids_);
-                assert_side_invariants(asks_);
+                size_t orders = assert_side_invariants(bids_) + assert_side_invariants(asks_);
+                assert(orders == pool_.live());
+                assert(orders == by_id_.size());
             }
 #endif
     };
+
+    using OrderBook = BasicOrderBook<MapLadder>;
+    using DenseOrderBook = BasicOrderBook<ArrayLadder>;
+    using CompactOrderBook = BasicOrderBook<ArrayLadder, FlatIdMap, CompactLayout>;
+    using ProRataOrderBook = BasicOrderBook<ArrayLadder, FlatIdMap, WideLayout, ProRata>;
 }
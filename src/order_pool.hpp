@@ -0,0 +1,156 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "types.hpp"
+
+namespace me {
+    using Slot = uint32_t;
+    inline constexpr Slot kNilSlot = UINT32_MAX;
+
+    // Storage widths of a resting order. The API types stay 64-bit; a layout only
+    // decides how a resting order is packed inside the pool.
+    struct WideLayout {
+        using Px = int64_t;
+        using Qty = int64_t;
+
+        static bool fits(const Order &, const BookConfig &) { return true; }
+        static Px encode_px(Price px, const BookConfig &) { return px; }
+        static Price decode_px(Px px, const BookConfig &) { return px; }
+    };
+
+    // 32-bit quantities and prices stored as ticks from BookConfig::px_min: 24-byte
+    // hot records against 32 for WideLayout, and half-size cold records.
+    struct CompactLayout {
+        using Px = int32_t;
+        using Qty = int32_t;
+
+        static bool fits(const Order &o, const BookConfig &cfg) {
+            if (o.qty > std::numeric_limits<Qty>::max()) return false;
+            if ((o.px - cfg.px_min) % cfg.tick != 0) return false;
+            Price ticks = (o.px - cfg.px_min) / cfg.tick;
+            return ticks >= std::numeric_limits<Px>::min() && ticks <= std::numeric_limits<Px>::max();
+        }
+
+        static Px encode_px(Price px, const BookConfig &cfg) { return static_cast<Px>((px - cfg.px_min) / cfg.tick); }
+        static Price decode_px(Px px, const BookConfig &cfg) { return cfg.px_min + static_cast<Price>(px) * cfg.tick; }
+    };
+
+    // A resting order is split across two parallel arrays indexed by the same slot.
+    // The matching loop only reads the hot part (id, qty, queue link, and the owner
+    // for self-trade prevention, which fills what was padding in WideLayout);
+    // timestamps, price and the back link are touched by cancel/modify only. Side
+    // and type are implied by the level an order rests on, so they are not stored.
+    template<class L>
+    struct HotOrder {
+        OrderId id{};
+        typename L::Qty qty{};
+        Slot next{kNilSlot};
+        OwnerId owner{};
+    };
+
+    template<class L>
+    struct ColdOrder {
+        Ts ts{};
+        typename L::Px px{};
+        Slot prev{kNilSlot};
+    };
+
+    // Iceberg reserve, kept out of both arrays above: it is read only when a
+    // displayed slice on a level with hidden qty runs out. Zero for every slot that
+    // is not a live iceberg, so plain orders never write it.
+    template<class L>
+    struct ReserveOrder {
+        typename L::Qty qty{};
+        typename L::Qty peak{};
+    };
+
+    static_assert(sizeof(HotOrder<CompactLayout>) == 24);
+    static_assert(sizeof(HotOrder<CompactLayout>) + sizeof(ColdOrder<CompactLayout>) == 40);
+    static_assert(sizeof(HotOrder<WideLayout>) + sizeof(ColdOrder<WideLayout>) == 48);
+
+    // Preallocated storage for resting orders. Slots are stable for the lifetime of
+    // an order and free slots are threaded through hot `next`, so acquire/release
+    // never touch the allocator until the pool has to grow past its reserved capacity.
+    template<class L>
+    class OrderPool {
+    public:
+        using Layout = L;
+        using Hot = HotOrder<L>;
+        using Cold = ColdOrder<L>;
+        using Reserve = ReserveOrder<L>;
+
+        explicit OrderPool(const BookConfig &cfg) : cfg_(cfg) { grow(cfg.order_capacity ? cfg.order_capacity : 1); }
+
+        bool fits(const Order &o) const { return L::fits(o, cfg_); }
+
+        // An iceberg (0 < display < qty) shows display and keeps the rest in reserve.
+        Slot acquire(const Order &o) {
+            if (free_ == kNilSlot) grow(hot_.size());
+            Slot s = free_;
+            Hot &h = hot_[s];
+            free_ = h.next;
+            h.id = o.id;
+            h.qty = static_cast<typename L::Qty>(o.qty);
+            h.owner = o.owner;
+            if (o.display > 0 && o.display < o.qty) {
+                h.qty = static_cast<typename L::Qty>(o.display);
+                reserve_[s] = Reserve{static_cast<typename L::Qty>(o.qty - o.display), h.qty};
+            }
+            h.next = kNilSlot;
+            Cold &c = cold_[s];
+            c.ts = o.ts;
+            c.px = L::encode_px(o.px, cfg_);
+            c.prev = kNilSlot;
+            ++live_;
+            return s;
+        }
+
+        void release(Slot s) {
+            hot_[s].next = free_;
+            free_ = s;
+            --live_;
+        }
+
+        // Returns a whole queue [first .. last] linked through hot `next` in O(1).
+        void release_chain(Slot first, Slot last, size_t n) {
+            hot_[last].next = free_;
+            free_ = first;
+            live_ -= n;
+        }
+
+        Hot &hot(Slot s) { return hot_[s]; }
+        const Hot &hot(Slot s) const { return hot_[s]; }
+        Cold &cold(Slot s) { return cold_[s]; }
+        const Cold &cold(Slot s) const { return cold_[s]; }
+        // Must be back to zero by the time the slot is released.
+        Reserve &reserve(Slot s) { return reserve_[s]; }
+        const Reserve &reserve(Slot s) const { return reserve_[s]; }
+
+        Price px_of(Slot s) const { return L::decode_px(cold_[s].px, cfg_); }
+        void set_px(Slot s, Price px) { cold_[s].px = L::encode_px(px, cfg_); }
+        OwnerId owner(Slot s) const { return hot_[s].owner; }
+
+        size_t live() const { return live_; }
+        size_t capacity() const { return hot_.size(); }
+
+    private:
+        BookConfig cfg_;
+        std::vector<Hot> hot_;
+        std::vector<Cold> cold_;
+        std::vector<Reserve> reserve_;
+        Slot free_{kNilSlot};
+        size_t live_{0};
+
+        void grow(size_t extra) {
+            size_t first = hot_.size();
+            hot_.resize(first + extra);
+            cold_.resize(first + extra);
+            reserve_.resize(first + extra);
+            for (size_t i = hot_.size(); i-- > first;) {
+                hot_[i].next = free_;
+                free_ = static_cast<Slot>(i);
+            }
+        }
+    };
+}
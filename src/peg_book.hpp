@@ -0,0 +1,172 @@
+#pragma once
+#include <array>
+#include <iterator>
+#include <map>
+#include "id_index.hpp"
+#include "price_level.hpp"
+
+namespace me {
+    // Pegged orders, queued FIFO in groups that share side, peg type and offset.
+    // A group has no price of its own: the book derives it from the lit touch when
+    // it needs one, so a BBO move reprices every group without touching an order.
+    // Groups are ordered by offset, so the most aggressive group of each type is
+    // the first one.
+    class PegBook {
+    public:
+        using Pool = OrderPool<WideLayout>;
+
+        struct Ref {
+            Slot slot{kNilSlot};
+            Side side{};
+            PegType type{};
+            Price offset{};
+        };
+
+        explicit PegBook(const BookConfig &cfg) : pool_(sized(cfg)), ids_(kInitialCapacity), tick_(cfg.tick) {
+        }
+
+        bool empty(Side s) const { return live_[idx(s)] == 0; }
+        size_t size() const { return ids_.size(); }
+        const Ref *find(OrderId id) const { return ids_.find(id); }
+
+        // False on a duplicate id, a missing peg type, a negative or off-tick
+        // offset or an iceberg display (pegs always show their full qty).
+        bool add(const Order &o) {
+            if (o.id == kNoOrderId || o.peg == PegType::None || o.peg_offset < 0 || o.peg_offset % tick_ != 0 ||
+                o.display > 0 || ids_.find(o.id))
+                return false;
+            Slot s = pool_.acquire(o);
+            ids_.insert(o.id, Ref{s, o.side, o.peg, o.peg_offset});
+            PriceLevel &g = groups(o.side, o.peg)[o.peg_offset];
+            g.px = o.peg_offset;
+            g.push(pool_, s);
+            ++live_[idx(o.side)];
+            return true;
+        }
+
+        bool cancel(OrderId id) {
+            const Ref *r = ids_.find(id);
+            if (!r) return false;
+            auto &gs = groups(r->side, r->type);
+            auto it = gs.find(r->offset);
+            it->second.erase(pool_, r->slot);
+            pool_.release(r->slot);
+            if (it->second.empty()) gs.erase(it);
+            --live_[idx(r->side)];
+            ids_.erase(id);
+            return true;
+        }
+
+        // Removes every peg on side s whose owner satisfies pred, reporting its id.
+        template<class Pred, class IdSink>
+        size_t cancel_if(Side s, Pred &&pred, IdSink &sink) {
+            size_t n = 0;
+            for (PegType t: {PegType::Primary, PegType::Mid}) {
+                auto &gs = groups(s, t);
+                for (auto it = gs.begin(); it != gs.end();) {
+                    PriceLevel &g = it->second;
+                    for (Slot slot = g.head; slot != kNilSlot;) {
+                        Slot next = pool_.hot(slot).next;
+                        if (pred(pool_.owner(slot))) {
+                            OrderId id = pool_.hot(slot).id;
+                            g.erase(pool_, slot);
+                            pool_.release(slot);
+                            ids_.erase(id);
+                            sink(id);
+                            ++n;
+                        }
+                        slot = next;
+                    }
+                    it = g.empty() ? gs.erase(it) : std::next(it);
+                }
+            }
+            live_[idx(s)] -= n;
+            return n;
+        }
+
+        // The most aggressive group of type t on side s, or nullptr. Its px is the offset.
+        const PriceLevel *front(Side s, PegType t) const {
+            const auto &gs = groups_[slot_of(s, t)];
+            return gs.empty() ? nullptr : &gs.begin()->second;
+        }
+
+        // Whether any peg on side s belongs to owner; O(pegs on that side).
+        bool has_owner(Side s, OwnerId owner) const {
+            for (PegType t: {PegType::Primary, PegType::Mid}) {
+                for (const auto &[offset, g]: groups_[slot_of(s, t)]) {
+                    for (Slot slot = g.head; slot != kNilSlot; slot = pool_.hot(slot).next) {
+                        if (pool_.owner(slot) == owner) return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // Fills taker at px against the front group of type t on side s, in queue
+        // order, until either runs out. A maker owned by stp_owner is resolved by
+        // taker.stp as on a lit level instead of trading; makers removed that way
+        // are reported through cancelled(OrderId). Returns whether anything traded.
+        template<class Sink, class IdSink>
+        bool fill(Side s, PegType t, Order &taker, Price px, OwnerId stp_owner, Sink &sink, IdSink &&cancelled) {
+            auto &gs = groups(s, t);
+            auto it = gs.begin();
+            PriceLevel &g = it->second;
+            bool traded = false;
+            while (taker.qty > 0 && !g.empty()) {
+                Slot slot = g.head;
+                auto &maker = pool_.hot(slot);
+                OrderId maker_id = maker.id;
+                Qty fill = (taker.qty < maker.qty) ? taker.qty : maker.qty;
+                if (maker.owner == stp_owner) [[unlikely]] {
+                    if (taker.stp == Stp::CancelNewest || taker.stp == Stp::CancelBoth) taker.qty = 0;
+                    if (taker.stp == Stp::CancelNewest) break;
+                    // Decrement takes the smaller qty off both; the cancels drop the maker.
+                    Qty d = taker.stp == Stp::Decrement ? fill : maker.qty;
+                    if (taker.stp == Stp::Decrement) taker.qty -= d;
+                    maker.qty -= d;
+                    g.total -= d;
+                    if (maker.qty == 0) {
+                        retire_front(s, g, slot, maker_id);
+                        cancelled(maker_id);
+                    }
+                    continue;
+                }
+                sink(Trade{taker.id, maker_id, px, fill, taker.ts});
+                traded = true;
+                taker.qty -= fill;
+                maker.qty -= fill;
+                g.total -= fill;
+                if (maker.qty == 0) retire_front(s, g, slot, maker_id);
+            }
+            if (g.empty()) gs.erase(it);
+            return traded;
+        }
+
+    private:
+        static constexpr size_t kInitialCapacity = 1024;
+
+        using Groups = std::map<Price, PriceLevel>;
+
+        Pool pool_;
+        FlatIdMap<Ref> ids_;
+        std::array<Groups, 4> groups_;
+        std::array<size_t, 2> live_{};
+        Price tick_;
+
+        static BookConfig sized(BookConfig cfg) {
+            cfg.order_capacity = kInitialCapacity;
+            return cfg;
+        }
+
+        void retire_front(Side s, PriceLevel &g, Slot slot, OrderId id) {
+            g.pop_front(pool_);
+            pool_.release(slot);
+            ids_.erase(id);
+            --live_[idx(s)];
+        }
+
+        static size_t idx(Side s) { return s == Side::Buy ? 0 : 1; }
+        static size_t slot_of(Side s, PegType t) { return idx(s) * 2 + (t == PegType::Mid ? 1 : 0); }
+        Groups &groups(Side s, PegType t) { return groups_[slot_of(s, t)]; }
+    };
+}
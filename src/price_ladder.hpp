@@ -0,0 +1,284 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <map>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "depth_tree.hpp"
+#include "level_bitmap.hpp"
+#include "price_level.hpp"
+
+namespace me {
+    // One side of the book. Both ladders expose the same surface so OrderBook can
+    // be instantiated over either: best() is the level with the highest priority
+    // (highest bid / lowest ask), for_each() walks non-empty levels best-first.
+    // depth_through(limit) is the qty resting at limit or better (iceberg reserve
+    // included) and price_for_qty(q) the worst price a sweep of q reaches; the book
+    // reports every change of a level's depth through add_depth().
+
+    template<Side S>
+    using PriceOrder = std::conditional_t<S == Side::Buy, std::greater<Price>, std::less<Price> >;
+
+    // Node-based ladder. Emptied levels are detached with extract() and parked on a
+    // bounded spare list, so liquidity flickering at the touch re-links an existing
+    // node instead of going back to the allocator.
+    template<Side S>
+    class MapLadder {
+    public:
+        using Map = std::map<Price, PriceLevel, PriceOrder<S> >;
+
+        explicit MapLadder(const BookConfig &cfg) : cache_(cfg.level_cache) {
+            spare_.reserve(cache_);
+        }
+
+        bool empty() const { return levels_.empty(); }
+        size_t size() const { return levels_.size(); }
+        bool accepts(Price) const { return true; }
+        const LadderStats &stats() const { return stats_; }
+
+        PriceLevel *best() { return levels_.empty() ? nullptr : &levels_.begin()->second; }
+        const PriceLevel *best() const { return levels_.empty() ? nullptr : &levels_.begin()->second; }
+
+        PriceLevel *find(Price px) {
+            auto it = levels_.find(px);
+            return it == levels_.end() ? nullptr : &it->second;
+        }
+
+        PriceLevel *ensure(Price px) {
+            auto it = levels_.lower_bound(px);
+            if (it != levels_.end() && it->first == px) return &it->second;
+            if (!spare_.empty()) {
+                auto nh = std::move(spare_.back());
+                spare_.pop_back();
+                nh.key() = px;
+                nh.mapped() = PriceLevel{};
+                nh.mapped().px = px;
+                it = levels_.insert(it, std::move(nh));
+                ++stats_.levels_reused;
+            } else {
+                it = levels_.emplace_hint(it, px, PriceLevel{});
+                it->second.px = px;
+                ++stats_.levels_created;
+            }
+            return &it->second;
+        }
+
+        void pop_best() { retire(levels_.begin()); }
+
+        void erase_if_empty(Price px) {
+            auto it = levels_.find(px);
+            if (it != levels_.end() && it->second.empty()) retire(it);
+        }
+
+        template<class F>
+        void for_each(F &&f) const {
+            for (const auto &[px, lvl]: levels_) f(lvl);
+        }
+
+        // Like for_each, but stops at the first level for which f returns false.
+        template<class F>
+        void walk(F &&f) const {
+            for (const auto &[px, lvl]: levels_) {
+                if (!f(lvl)) return;
+            }
+        }
+
+        void add_depth(const PriceLevel &, Qty) {
+        }
+
+        // Visits the levels priced in [lo, hi]; f may unlink any of their orders and
+        // levels left empty are retired. Nothing is visited if lo > hi.
+        template<class F>
+        void prune(Price lo, Price hi, F &&f) {
+            if (lo > hi) return;
+            auto it = levels_.lower_bound(S == Side::Buy ? hi : lo);
+            auto end = levels_.upper_bound(S == Side::Buy ? lo : hi);
+            while (it != end) {
+                auto cur = it++;
+                f(cur->second);
+                if (cur->second.empty()) retire(cur);
+            }
+        }
+
+        // Walks levels from the touch; cost grows with the number of levels reached.
+        // The walk stops early once `enough` has accumulated.
+        Qty depth_through(Price limit, Qty enough = std::numeric_limits<Qty>::max()) const {
+            Qty sum = 0;
+            for (auto it = levels_.begin(); it != levels_.end() && !PriceOrder<S>{}(limit, it->first); ++it) {
+                sum += it->second.depth();
+                if (sum >= enough) break;
+            }
+            return sum;
+        }
+
+        std::optional<Price> price_for_qty(Qty q) const {
+            for (const auto &[px, lvl]: levels_) {
+                q -= lvl.depth();
+                if (q <= 0) return px;
+            }
+            return std::nullopt;
+        }
+
+    private:
+        Map levels_;
+        std::vector<typename Map::node_type> spare_;
+        size_t cache_;
+        LadderStats stats_;
+
+        void retire(typename Map::iterator it) {
+            if (spare_.size() < cache_) spare_.push_back(levels_.extract(it));
+            else levels_.erase(it);
+        }
+    };
+
+    // Contiguous ladder over [px_min, px_max] with a fixed tick: level lookup and
+    // creation are a single index computation, and the next occupied tick after the
+    // best level empties comes from the occupancy bitmap rather than a scan. Level
+    // totals are mirrored into a Fenwick tree so depth queries are O(log L). Prices
+    // outside the band or off the tick grid are not accepted and cannot rest.
+    template<Side S>
+    class ArrayLadder {
+    public:
+        explicit ArrayLadder(const BookConfig &cfg)
+            : lo_(cfg.px_min), hi_(cfg.px_max), tick_(cfg.tick),
+              occupied_(static_cast<size_t>((hi_ - lo_) / tick_ + 1)),
+              depth_(static_cast<size_t>((hi_ - lo_) / tick_ + 1)) {
+            levels_.resize(static_cast<size_t>((hi_ - lo_) / tick_ + 1));
+            for (size_t i = 0; i < levels_.size(); ++i) levels_[i].px = lo_ + static_cast<Price>(i) * tick_;
+        }
+
+        bool empty() const { return best_ < 0; }
+        size_t size() const { return live_; }
+        // Every slot is preallocated, so each activation counts as a reuse.
+        const LadderStats &stats() const { return stats_; }
+
+        bool accepts(Price px) const {
+            return px >= lo_ && px <= hi_ && (px - lo_) % tick_ == 0;
+        }
+
+        PriceLevel *best() { return best_ < 0 ? nullptr : &levels_[best_]; }
+        const PriceLevel *best() const { return best_ < 0 ? nullptr : &levels_[best_]; }
+
+        PriceLevel *find(Price px) {
+            if (!accepts(px)) return nullptr;
+            PriceLevel &lvl = levels_[index(px)];
+            return lvl.empty() ? nullptr : &lvl;
+        }
+
+        PriceLevel *ensure(Price px) {
+            if (!accepts(px)) return nullptr;
+            std::ptrdiff_t i = index(px);
+            PriceLevel &lvl = levels_[i];
+            if (lvl.empty()) {
+                ++live_;
+                ++stats_.levels_reused;
+                occupied_.set(static_cast<size_t>(i));
+                if (best_ < 0 || better(i, best_)) best_ = i;
+            }
+            return &lvl;
+        }
+
+        void pop_best() { release(best_); }
+
+        void erase_if_empty(Price px) {
+            if (!accepts(px)) return;
+            std::ptrdiff_t i = index(px);
+            if (levels_[i].empty()) release(i);
+        }
+
+        template<class F>
+        void for_each(F &&f) const {
+            for (std::ptrdiff_t i = best_; i >= 0; i = next_worse(i)) f(levels_[i]);
+        }
+
+        template<class F>
+        void walk(F &&f) const {
+            for (std::ptrdiff_t i = best_; i >= 0 && f(levels_[i]); i = next_worse(i)) {
+            }
+        }
+
+        void add_depth(const PriceLevel &lvl, Qty delta) {
+            depth_.add(rank(&lvl - levels_.data()), delta);
+        }
+
+        // Same contract as MapLadder::prune; only occupied ticks are visited.
+        template<class F>
+        void prune(Price lo, Price hi, F &&f) {
+            if (hi < lo_ || lo > hi_) return;
+            size_t first = lo <= lo_ ? 0 : static_cast<size_t>((lo - lo_ + tick_ - 1) / tick_);
+            size_t last = hi >= hi_ ? levels_.size() - 1 : static_cast<size_t>((hi - lo_) / tick_);
+            for (size_t i = occupied_.next_at_or_after(first); i != LevelBitmap::npos && i <= last;
+                 i = occupied_.next_at_or_after(i + 1)) {
+                PriceLevel &lvl = levels_[i];
+                Qty before = lvl.depth();
+                f(lvl);
+                depth_.add(rank(static_cast<std::ptrdiff_t>(i)), lvl.depth() - before);
+                if (lvl.empty()) release(static_cast<std::ptrdiff_t>(i));
+            }
+        }
+
+        Qty depth_through(Price limit, Qty = std::numeric_limits<Qty>::max()) const {
+            std::ptrdiff_t last = static_cast<std::ptrdiff_t>(levels_.size()) - 1;
+            if constexpr (S == Side::Buy) {
+                if (limit > hi_) return 0;
+                std::ptrdiff_t i = limit <= lo_ ? 0 : (limit - lo_ + tick_ - 1) / tick_;
+                return depth_.prefix(rank(i));
+            } else {
+                if (limit < lo_) return 0;
+                std::ptrdiff_t i = limit >= hi_ ? last : (limit - lo_) / tick_;
+                return depth_.prefix(rank(i));
+            }
+        }
+
+        std::optional<Price> price_for_qty(Qty q) const {
+            size_t pos = depth_.lower_bound(q);
+            if (pos == depth_.size()) return std::nullopt;
+            return levels_[rank(static_cast<std::ptrdiff_t>(pos))].px;
+        }
+
+    private:
+        Price lo_;
+        Price hi_;
+        Price tick_;
+        std::vector<PriceLevel> levels_;
+        std::ptrdiff_t best_{-1};
+        size_t live_{0};
+        LevelBitmap occupied_;
+        DepthTree depth_;
+        LadderStats stats_;
+
+        // Position of tick i in priority order; the mapping is its own inverse.
+        size_t rank(std::ptrdiff_t i) const {
+            if constexpr (S == Side::Buy) return levels_.size() - 1 - static_cast<size_t>(i);
+            else return static_cast<size_t>(i);
+        }
+
+        std::ptrdiff_t index(Price px) const { return static_cast<std::ptrdiff_t>((px - lo_) / tick_); }
+
+        static bool better(std::ptrdiff_t a, std::ptrdiff_t b) {
+            if constexpr (S == Side::Buy) return a > b;
+            else return a < b;
+        }
+
+        // Next occupied tick strictly behind i in priority order, or -1.
+        std::ptrdiff_t next_worse(std::ptrdiff_t i) const {
+            size_t j;
+            if constexpr (S == Side::Buy) {
+                if (i == 0) return -1;
+                j = occupied_.prev_at_or_before(static_cast<size_t>(i - 1));
+            } else {
+                j = occupied_.next_at_or_after(static_cast<size_t>(i + 1));
+            }
+            return j == LevelBitmap::npos ? -1 : static_cast<std::ptrdiff_t>(j);
+        }
+
+        // Called once the level at i has been emptied.
+        void release(std::ptrdiff_t i) {
+            --live_;
+            occupied_.reset(static_cast<size_t>(i));
+            if (i == best_) best_ = next_worse(i);
+        }
+    };
+}
@@ -1,36 +1,70 @@
 #pragma once
-#include <list>
-#include <utility>
-#include "types.hpp"
+#include "order_pool.hpp"
 
 namespace me {
+    // FIFO of resting orders at one price, linked intrusively through pool slots.
+    // Forward links live in the hot array; back links in the cold array and are only
+    // kept for non-head nodes, so popping the head never touches cold data.
+    // Unlinking does not release the slot; the owner of the pool decides that.
+    // total is the visible queue; hidden is the iceberg reserve behind it, which
+    // counts toward depth but is never matched until it replenishes a slice.
     struct PriceLevel {
         Price px{};
-        std::list<Order> dq;
         Qty total{0};
+        Qty hidden{0};
+        Slot head{kNilSlot};
+        Slot tail{kNilSlot};
+        uint32_t count{0};
 
-        bool empty() const { return dq.empty(); }
-        size_t size() const { return dq.size(); }
+        bool empty() const { return head == kNilSlot; }
+        size_t size() const { return count; }
+        Qty depth() const { return total + hidden; }
 
-        const Order &front() const { return dq.front(); }
-        Order &front() { return dq.front(); }
+        template<class Pool>
+        void push(Pool &pool, Slot s) {
+            auto &h = pool.hot(s);
+            total += h.qty;
+            h.next = kNilSlot;
+            if (tail != kNilSlot) {
+                pool.hot(tail).next = s;
+                pool.cold(s).prev = tail;
+            } else {
+                head = s;
+            }
+            tail = s;
+            ++count;
+        }
 
-        std::list<Order>::iterator push(Order o) {
-            total += o.qty;
-            dq.push_back(std::move(o));
-            auto it = dq.end();
-            --it;
-            return it;
+        // Forgets the whole queue; the caller owns the detached chain head..tail.
+        void detach_all() {
+            head = tail = kNilSlot;
+            total = 0;
+            hidden = 0;
+            count = 0;
         }
 
-        void pop_front() {
-            total -= dq.front().qty;
-            dq.pop_front();
+        template<class Pool>
+        void pop_front(Pool &pool) {
+            auto &h = pool.hot(head);
+            total -= h.qty;
+            head = h.next;
+            if (head == kNilSlot) tail = kNilSlot;
+            --count;
         }
 
-        void erase(std::list<Order>::iterator it) {
-            total -= it->qty;
-            dq.erase(it);
+        template<class Pool>
+        void erase(Pool &pool, Slot s) {
+            if (s == head) {
+                pop_front(pool);
+                return;
+            }
+            auto &h = pool.hot(s);
+            Slot prev = pool.cold(s).prev;
+            total -= h.qty;
+            pool.hot(prev).next = h.next;
+            if (h.next != kNilSlot) pool.cold(h.next).prev = prev;
+            else tail = prev;
+            --count;
         }
     };
 }
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace me {
+    // Bounded single-producer/single-consumer ring of trivially copyable records.
+    // The two shared indices and each side's private counters sit on four
+    // separate cache lines, so staging writes nothing the other side reads and a
+    // batch costs one transfer of each shared line. The producer keeps a cached
+    // copy of the consumer's, so it reads the consumer line only when the ring
+    // looks full. It stages records with try_push() and makes them visible with
+    // a single release store in publish(). The consumer drains everything
+    // published so far, loading the producer index and storing its own once per
+    // batch.
+    template<class T>
+    class SpscRing {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+    public:
+        // Capacity is rounded up to a power of two.
+        explicit SpscRing(std::size_t capacity) {
+            std::size_t n = 2;
+            while (n < capacity) n <<= 1;
+            slots_.resize(n);
+            mask_ = n - 1;
+        }
+
+        SpscRing(const SpscRing &) = delete;
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        std::size_t capacity() const { return slots_.size(); }
+
+        // Producer. False if the ring is full; staged records count against capacity.
+        bool try_push(const T &v) {
+            if (staged_ - head_cache_ == slots_.size()) {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (staged_ - head_cache_ == slots_.size()) return false;
+            }
+            slots_[staged_ & mask_] = v;
+            ++staged_;
+            return true;
+        }
+
+        // Producer. Makes everything staged visible to the consumer.
+        void publish() {
+            if (staged_ != published_) {
+                published_ = staged_;
+                tail_.store(staged_, std::memory_order_release);
+            }
+        }
+
+        std::size_t unpublished() const { return staged_ - published_; }
+
+        // Consumer. Calls f(const T&) for up to max published records and returns
+        // how many were consumed.
+        template<class F>
+        std::size_t drain(F &&f, std::size_t max = SIZE_MAX) {
+            std::size_t n = tail_.load(std::memory_order_acquire) - head_local_;
+            if (n == 0) return 0;
+            if (n > max) n = max;
+            for (std::size_t i = 0; i < n; ++i) f(slots_[(head_local_ + i) & mask_]);
+            head_local_ += n;
+            head_.store(head_local_, std::memory_order_release);
+            return n;
+        }
+
+        // Either side; exact only when the other side is idle.
+        bool empty() const {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::vector<T> slots_;
+        std::size_t mask_{0};
+
+        // Written by the consumer, read by the producer when the ring looks full.
+        alignas(64) std::atomic<std::size_t> head_{0};
+        // Written by the producer once per batch, polled by the consumer.
+        alignas(64) std::atomic<std::size_t> tail_{0};
+
+        // Consumer only.
+        alignas(64) std::size_t head_local_{0};
+
+        // Producer only; try_push() writes here and nowhere shared.
+        alignas(64) std::size_t staged_{0};
+        std::size_t published_{0};
+        std::size_t head_cache_{0};
+    };
+}
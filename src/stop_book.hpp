@@ -0,0 +1,109 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <vector>
+#include "id_index.hpp"
+
+namespace me {
+    // Resting stop and stop-limit orders, ordered by stop price per side. Buy stops
+    // fire when the last trade prints at or above their stop, sell stops at or
+    // below. The nearest trigger on each side is cached, so checking a trade price
+    // that fires nothing is one comparison per side.
+    class StopBook {
+    public:
+        explicit StopBook(size_t capacity = 0) : ids_(capacity) {
+        }
+
+        bool empty() const { return ids_.empty(); }
+        size_t size() const { return ids_.size(); }
+        bool contains(OrderId id) const { return ids_.find(id) != nullptr; }
+
+        bool armed(Price last) const { return last >= buy_trigger_ || last <= sell_trigger_; }
+
+        // False on a duplicate id.
+        bool add(const Order &o) {
+            if (o.id == kNoOrderId || contains(o.id)) return false;
+            Stops &book = (o.side == Side::Buy) ? buys_ : sells_;
+            auto it = book.emplace(o.stop_px, Entry{seq_++, o});
+            ids_.insert(o.id, Ref{it, o.side});
+            refresh_triggers();
+            return true;
+        }
+
+        bool cancel(OrderId id) {
+            const Ref *r = ids_.find(id);
+            if (!r) return false;
+            ((r->side == Side::Buy) ? buys_ : sells_).erase(r->it);
+            ids_.erase(id);
+            refresh_triggers();
+            return true;
+        }
+
+        // Removes every stop for which pred(const Order&) holds, reporting its id.
+        template<class Pred, class IdSink>
+        size_t cancel_if(Pred &&pred, IdSink &sink) {
+            size_t n = 0;
+            for (Stops *book: {&buys_, &sells_}) {
+                for (auto it = book->begin(); it != book->end();) {
+                    if (!pred(it->second.o)) {
+                        ++it;
+                        continue;
+                    }
+                    OrderId id = it->second.o.id;
+                    it = book->erase(it);
+                    ids_.erase(id);
+                    sink(id);
+                    ++n;
+                }
+            }
+            if (n) refresh_triggers();
+            return n;
+        }
+
+        // Appends every stop fired by a print at last to out, oldest first.
+        void take_triggered(Price last, std::vector<Order> &out) {
+            fired_.clear();
+            auto buy_end = buys_.upper_bound(last);
+            auto sell_begin = sells_.lower_bound(last);
+            for (auto it = buys_.begin(); it != buy_end; ++it) fired_.push_back(it->second);
+            for (auto it = sell_begin; it != sells_.end(); ++it) fired_.push_back(it->second);
+            buys_.erase(buys_.begin(), buy_end);
+            sells_.erase(sell_begin, sells_.end());
+            std::sort(fired_.begin(), fired_.end(), [](const Entry &a, const Entry &b) { return a.seq < b.seq; });
+            for (const Entry &e: fired_) {
+                ids_.erase(e.o.id);
+                out.push_back(e.o);
+            }
+            refresh_triggers();
+        }
+
+    private:
+        struct Entry {
+            uint64_t seq{};
+            Order o{};
+        };
+
+        using Stops = std::multimap<Price, Entry>;
+
+        struct Ref {
+            Stops::iterator it{};
+            Side side{};
+        };
+
+        Stops buys_;
+        Stops sells_;
+        FlatIdMap<Ref> ids_;
+        std::vector<Entry> fired_;
+        uint64_t seq_{0};
+        Price buy_trigger_{std::numeric_limits<Price>::max()};
+        Price sell_trigger_{std::numeric_limits<Price>::min()};
+
+        void refresh_triggers() {
+            buy_trigger_ = buys_.empty() ? std::numeric_limits<Price>::max() : buys_.begin()->first;
+            sell_trigger_ = sells_.empty() ? std::numeric_limits<Price>::min() : std::prev(sells_.end())->first;
+        }
+    };
+}
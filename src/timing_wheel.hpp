@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+#include "types.hpp"
+
+namespace me {
+    // Hierarchical timing wheel over expiry times, in units of `resolution`. Level k
+    // has 64 slots of 64^k units each; an entry sits on the lowest level whose
+    // current 64^(k+1)-unit block contains its time, so every occupied slot lies
+    // ahead of the clock within its level's rotation. Scheduling is a push_back;
+    // advancing jumps between occupied slots using per-level bitmasks and cascades a
+    // slot down a level when the clock enters it. Entries fire on the first
+    // advance at or after their time rounded up to the resolution.
+    class TimingWheel {
+    public:
+        static constexpr unsigned kSlotBits = 6;
+        static constexpr size_t kSlots = size_t{1} << kSlotBits;
+        static constexpr unsigned kLevels = 8;
+
+        struct Entry {
+            OrderId id{};
+            Ts at{};
+        };
+
+        explicit TimingWheel(Ts resolution = 1) : res_(resolution ? resolution : 1) {
+        }
+
+        bool empty() const { return size_ == 0; }
+        size_t size() const { return size_; }
+
+        // Times at or before the clock fire on the next advance.
+        void schedule(OrderId id, Ts at) {
+            uint64_t t = at / res_ + (at % res_ != 0);
+            ++size_;
+            if (t <= cur_) due_.push_back(Entry{id, at});
+            else place(Entry{id, at}, t);
+        }
+
+        // Moves the clock forward to now and appends everything due to out.
+        void advance(Ts now, std::vector<Entry> &out) {
+            uint64_t target = now / res_;
+            drain(due_, out);
+            while (cur_ < target) {
+                cur_ = next_stop(target);
+                if ((cur_ & span_mask(kLevels)) == 0 && !overflow_.empty()) {
+                    std::vector<Entry> far;
+                    far.swap(overflow_);
+                    for (const Entry &e: far) place(e, e.at / res_ + (e.at % res_ != 0));
+                }
+                for (unsigned k = kLevels - 1; k >= 1; --k) {
+                    if ((cur_ & span_mask(k)) == 0) cascade(k);
+                }
+                size_t s = cur_ & (kSlots - 1);
+                occ_[0] &= ~(uint64_t{1} << s);
+                drain(slots_[0][s], out);
+            }
+        }
+
+    private:
+        Ts res_;
+        uint64_t cur_{0};
+        size_t size_{0};
+        std::array<std::array<std::vector<Entry>, kSlots>, kLevels> slots_;
+        std::array<uint64_t, kLevels> occ_{};
+        std::vector<Entry> due_;
+        std::vector<Entry> overflow_;
+
+        static uint64_t span_mask(unsigned k) { return (uint64_t{1} << (kSlotBits * k)) - 1; }
+
+        // t >= cur_.
+        void place(const Entry &e, uint64_t t) {
+            for (unsigned k = 0; k < kLevels; ++k) {
+                unsigned up = kSlotBits * (k + 1);
+                if ((t >> up) == (cur_ >> up)) {
+                    size_t s = (t >> (kSlotBits * k)) & (kSlots - 1);
+                    slots_[k][s].push_back(e);
+                    occ_[k] |= uint64_t{1} << s;
+                    return;
+                }
+            }
+            overflow_.push_back(e);
+        }
+
+        void cascade(unsigned k) {
+            size_t s = (cur_ >> (kSlotBits * k)) & (kSlots - 1);
+            if (!(occ_[k] >> s & 1u)) return;
+            occ_[k] &= ~(uint64_t{1} << s);
+            std::vector<Entry> moving;
+            moving.swap(slots_[k][s]);
+            for (const Entry &e: moving) place(e, e.at / res_ + (e.at % res_ != 0));
+            // Hand the buffer back so the slot keeps its capacity.
+            moving.clear();
+            slots_[k][s].swap(moving);
+        }
+
+        // Earliest time after cur_ at which some slot is entered, capped at target.
+        uint64_t next_stop(uint64_t target) const {
+            uint64_t best = target;
+            if (!overflow_.empty()) best = std::min(best, (cur_ | span_mask(kLevels)) + 1);
+            for (unsigned k = 0; k < kLevels; ++k) {
+                size_t idx = (cur_ >> (kSlotBits * k)) & (kSlots - 1);
+                uint64_t ahead = occ_[k] & ~((uint64_t{2} << idx) - 1);
+                if (!ahead) continue;
+                unsigned up = kSlotBits * (k + 1);
+                uint64_t block = (cur_ >> up) << up;
+                best = std::min(best, block + (uint64_t{static_cast<unsigned>(std::countr_zero(ahead))} << (kSlotBits * k)));
+            }
+            return best;
+        }
+
+        void drain(std::vector<Entry> &from, std::vector<Entry> &out) {
+            size_ -= from.size();
+            out.insert(out.end(), from.begin(), from.end());
+            from.clear();
+        }
+    };
+}
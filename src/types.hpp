@@ -1,15 +1,50 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 
 namespace me {
     enum class Side : uint8_t { Buy, Sell };
 
-    enum class OrdType : uint8_t { Limit, Market };
+    constexpr Side opposite(Side s) { return s == Side::Buy ? Side::Sell : Side::Buy; }
+
+    // Stop becomes a market order and StopLimit a limit order at px once the last
+    // trade price reaches stop_px.
+    enum class OrdType : uint8_t { Limit, Market, Stop, StopLimit };
+
+    // Gtc rests any remainder; Ioc cancels it; Fok executes in full or not at all.
+    // Gtd rests until expire_ts and Day until BookConfig::session_close, as seen by
+    // the clock the caller passes to advance_clock().
+    enum class TimeInForce : uint8_t { Gtc, Ioc, Fok, Gtd, Day };
+
+    // A post-only order that would cross is rejected, or slid to one tick behind the
+    // opposite touch; either way it never enters the matcher.
+    enum class PostOnly : uint8_t { Off, Reject, Slide };
+
+    // Continuous matches on arrival. In Call orders only accumulate (market, IOC
+    // and FOK orders are rejected) until the book is uncrossed at one price.
+    enum class Phase : uint8_t { Continuous, Call };
+
+    // Primary follows the touch on the order's own side, Mid the midpoint of the lit
+    // BBO (rounded to the tick away from the opposite side). peg_offset is the
+    // distance behind that reference.
+    enum class PegType : uint8_t { None, Primary, Mid };
 
     using Price = int64_t;
     using Qty = int64_t;
     using OrderId = uint64_t;
+    // Reserved as the empty marker of id tables; never accepted as an order id.
+    inline constexpr OrderId kNoOrderId = UINT64_MAX;
     using Ts = uint64_t;
+    // Trading session or account an order belongs to, for mass cancel and
+    // self-trade prevention. kNoOwner is reserved.
+    using OwnerId = uint32_t;
+    inline constexpr OwnerId kNoOwner = UINT32_MAX;
+
+    // Self-trade prevention, chosen by the taker, when it meets a resting order of
+    // the same owner: CancelNewest drops the taker's remainder, CancelOldest the
+    // resting order, CancelBoth both; Decrement takes the smaller qty off both
+    // without a trade.
+    enum class Stp : uint8_t { Off, CancelNewest, CancelOldest, CancelBoth, Decrement };
 
     struct Order {
         OrderId id{};
@@ -18,6 +53,16 @@ namespace me {
         Price px{0};
         Qty qty{0};
         Ts ts{0};
+        TimeInForce tif{TimeInForce::Gtc};
+        PostOnly post_only{PostOnly::Off};
+        Price stop_px{0};
+        // Iceberg: only `display` of qty is shown at a time; 0 shows it all.
+        Qty display{0};
+        PegType peg{PegType::None};
+        Price peg_offset{0};
+        Ts expire_ts{0};
+        OwnerId owner{0};
+        Stp stp{Stp::Off};
     };
 
     struct Trade {
@@ -27,4 +72,26 @@ namespace me {
         Qty qty{};
         Ts ts{};
     };
+
+    struct BookConfig {
+        // Price band and tick of the instrument; only dense ladders size themselves from it.
+        Price px_min{0};
+        Price px_max{65535};
+        Price tick{1};
+        // Resting orders preallocated by the order pool.
+        std::size_t order_capacity{1 << 16};
+        // First id handed out by the gateway; only dense id indexes use it.
+        OrderId base_id{0};
+        // Emptied levels a node-based ladder keeps per side for reuse instead of freeing.
+        std::size_t level_cache{64};
+        // Expiry of Day orders, and the granularity of the expiry wheel, in Ts units.
+        Ts session_close{0};
+        Ts expiry_resolution{1};
+    };
+
+    struct LadderStats {
+        // Level activations that had to allocate vs. ones served from recycled storage.
+        uint64_t levels_created{0};
+        uint64_t levels_reused{0};
+    };
 }